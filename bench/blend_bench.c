@@ -0,0 +1,169 @@
+/*
+MIT License
+
+Copyright (c) 2025 oOluki
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// checks that every blend, scaled blend and luminance kernel matches the scalar one bit for bit and prints their per pixel throughput
+// usage: BlendBench <optional: pixel count> <optional: repetitions>
+
+#include "../src/blend.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef void (*BlendRow)(uint32_t* dst, const uint32_t* src, int n);
+
+static uint32_t rng_state = 0x12345678;
+
+static uint32_t rng(void){
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+// random premultiplied color, with fully opaque and fully transparent pixels mixed in like in real sprites
+static uint32_t random_premultiplied(void){
+    const uint32_t roll = rng() % 4;
+    const uint32_t a = (roll == 0)? 0 : (roll == 1)? 255 : rng() % 256;
+    const uint32_t r = (rng() % 256) * a / 255;
+    const uint32_t g = (rng() % 256) * a / 255;
+    const uint32_t b = (rng() % 256) * a / 255;
+    return r | (g << 8) | (b << 16) | (a << 24);
+}
+
+static int bench(const char* name, BlendRow kernel, const uint32_t* src, const uint32_t* dst, uint32_t* out, const uint32_t* expected, int n, int reps){
+    memcpy(out, dst, n * sizeof(out[0]));
+    kernel(out, src, n);
+    if(memcmp(out, expected, n * sizeof(out[0]))){
+        printf("%-8s MISMATCH with scalar\n", name);
+        return 1;
+    }
+    const clock_t start = clock();
+    for(int i = 0; i < reps; i+=1) kernel(out, src, n);
+    const double seconds = (double) (clock() - start) / CLOCKS_PER_SEC;
+    const double pixels = (double) n * reps;
+    printf("%-8s %8.3f ns/pixel %10.1f Mpixels/s\n", name, seconds * 1e9 / pixels, pixels / seconds / 1e6);
+    return 0;
+}
+
+typedef void (*BlendScaledRow)(uint32_t* dst, const uint32_t* src, int n, uint32_t factors);
+
+static int bench_scaled(const char* name, BlendScaledRow kernel, uint32_t factors, const uint32_t* src, const uint32_t* dst, uint32_t* out, const uint32_t* expected, int n, int reps){
+    memcpy(out, dst, n * sizeof(out[0]));
+    kernel(out, src, n, factors);
+    if(memcmp(out, expected, n * sizeof(out[0]))){
+        printf("%-8s MISMATCH with scalar for factors %08X\n", name, factors);
+        return 1;
+    }
+    const clock_t start = clock();
+    for(int i = 0; i < reps; i+=1) kernel(out, src, n, factors);
+    const double seconds = (double) (clock() - start) / CLOCKS_PER_SEC;
+    const double pixels = (double) n * reps;
+    printf("%-8s %8.3f ns/pixel %10.1f Mpixels/s\n", name, seconds * 1e9 / pixels, pixels / seconds / 1e6);
+    return 0;
+}
+
+typedef void (*LuminanceRow)(uint8_t* dst, const uint32_t* src, int n);
+
+static int bench_luminance(const char* name, LuminanceRow kernel, const uint32_t* src, uint8_t* out, const uint8_t* expected, int n, int reps){
+    kernel(out, src, n);
+    if(memcmp(out, expected, n)){
+        printf("%-8s MISMATCH with scalar\n", name);
+        return 1;
+    }
+    const clock_t start = clock();
+    for(int i = 0; i < reps; i+=1) kernel(out, src, n);
+    const double seconds = (double) (clock() - start) / CLOCKS_PER_SEC;
+    const double pixels = (double) n * reps;
+    printf("%-8s %8.3f ns/pixel %10.1f Mpixels/s\n", name, seconds * 1e9 / pixels, pixels / seconds / 1e6);
+    return 0;
+}
+
+int main(int argc, char** argv){
+    const int n    = (argc > 1)? atoi(argv[1]) : 1 << 16;
+    const int reps = (argc > 2)? atoi(argv[2]) : 2000;
+    if(n <= 0 || reps <= 0){
+        fprintf(stderr, "[ERROR] usage: %s <optional: pixel count> <optional: repetitions>\n", argv[0]);
+        return 1;
+    }
+
+    uint32_t* const src      = malloc(n * sizeof(src[0]));
+    uint32_t* const dst      = malloc(n * sizeof(dst[0]));
+    uint32_t* const out      = malloc(n * sizeof(out[0]));
+    uint32_t* const expected = malloc(n * sizeof(expected[0]));
+    if(!src || !dst || !out || !expected){
+        fprintf(stderr, "[ERROR] could not allocate %i pixels\n", n);
+        return 1;
+    }
+    for(int i = 0; i < n; i+=1){
+        src[i] = random_premultiplied();
+        dst[i] = random_premultiplied() | 0xFF000000;
+    }
+    memcpy(expected, dst, n * sizeof(expected[0]));
+    blend_row_scalar(expected, src, n);
+
+    int err = 0;
+    printf("blending %i pixels %i times\n", n, reps);
+    err |= bench("scalar", blend_row_scalar, src, dst, out, expected, n, reps);
+#ifdef BLEND_X86
+    if(cpu_has_sse2()) err |= bench("sse2", blend_row_sse2, src, dst, out, expected, n, reps);
+    if(cpu_has_avx2()) err |= bench("avx2", blend_row_avx2, src, dst, out, expected, n, reps);
+#endif
+    blend_row(out, src, 0);
+    printf("the renderer uses the %s kernel\n", blend_row_name);
+
+    // the factors of a plain layer, of 30% opacity, of a red tint and of both, as set_layer_style_fields makes them
+    static const uint32_t factors[] = {0xFFFFFFFF, 0x4D4D4D4D, 0xFF0000FF, 0x4D00004D};
+    for(int f = 0; f < (int) (sizeof(factors) / sizeof(factors[0])); f+=1){
+        memcpy(expected, dst, n * sizeof(expected[0]));
+        blend_scaled_row_scalar(expected, src, n, factors[f]);
+        printf("scaled blending %i pixels %i times with factors %08X\n", n, reps, factors[f]);
+        err |= bench_scaled("scalar", blend_scaled_row_scalar, factors[f], src, dst, out, expected, n, reps);
+#ifdef BLEND_X86
+        if(cpu_has_sse2()) err |= bench_scaled("sse2", blend_scaled_row_sse2, factors[f], src, dst, out, expected, n, reps);
+        if(cpu_has_avx2()) err |= bench_scaled("avx2", blend_scaled_row_avx2, factors[f], src, dst, out, expected, n, reps);
+#endif
+    }
+
+    uint8_t* const luminance          = malloc(n);
+    uint8_t* const expected_luminance = malloc(n);
+    if(!luminance || !expected_luminance){
+        fprintf(stderr, "[ERROR] could not allocate %i pixels\n", n);
+        return 1;
+    }
+    luminance_row_scalar(expected_luminance, src, n);
+    printf("luminance of %i pixels %i times\n", n, reps);
+    err |= bench_luminance("scalar", luminance_row_scalar, src, luminance, expected_luminance, n, reps);
+#ifdef BLEND_X86
+    if(cpu_has_sse2()) err |= bench_luminance("sse2", luminance_row_sse2, src, luminance, expected_luminance, n, reps);
+#endif
+    free(luminance);
+    free(expected_luminance);
+
+    free(src);
+    free(dst);
+    free(out);
+    free(expected);
+    return err;
+}
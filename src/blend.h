@@ -0,0 +1,303 @@
+/*
+MIT License
+
+Copyright (c) 2025 oOluki
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// premultiplied 0xAABBGGRR blending and luminance kernels,
+// the simd versions are picked at runtime and give the exact same results as the scalar ones
+
+#ifndef BLEND_H
+#define BLEND_H
+
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+    #define BLEND_X86
+    #include <emmintrin.h>
+    #include <immintrin.h>
+    #if defined(_MSC_VER) && !defined(__clang__)
+        #include <intrin.h>
+        #define BLEND_TARGET_SSE2
+        #define BLEND_TARGET_AVX2
+    #else
+        #define BLEND_TARGET_SSE2 __attribute__((target("sse2")))
+        #define BLEND_TARGET_AVX2 __attribute__((target("avx2")))
+    #endif
+#endif
+
+// x / 255 rounded to nearest, exact for x in [0, 255 * 255]
+static inline uint32_t div255(const uint32_t x){
+    return (x + 128 + ((x + 128) >> 8)) >> 8;
+}
+
+// premultiplied "over", ct on top of cb
+static inline uint32_t blend_colors(const uint32_t ct, const uint32_t cb){
+    const uint32_t at = (ct >> 24) & 0xFF;
+    if(at == 255) return ct;
+    if(at == 0)   return cb;
+    const uint32_t inv = 255 - at;
+    const uint32_t ro = ((ct >>  0) & 0xFF) + div255(((cb >>  0) & 0xFF) * inv);
+    const uint32_t go = ((ct >>  8) & 0xFF) + div255(((cb >>  8) & 0xFF) * inv);
+    const uint32_t bo = ((ct >> 16) & 0xFF) + div255(((cb >> 16) & 0xFF) * inv);
+    const uint32_t ao = at                  + div255(((cb >> 24) & 0xFF) * inv);
+    return (ro << 0) | (go << 8) | (bo << 16) | (ao << 24);
+}
+
+// blends n src pixels over n dst pixels
+static void blend_row_scalar(uint32_t* dst, const uint32_t* src, int n){
+    for(int i = 0; i < n; i+=1) dst[i] = blend_colors(src[i], dst[i]);
+}
+
+#ifdef BLEND_X86
+
+// src16 + div255(dst16 * (255 - alpha16)) on 16 bit channels
+BLEND_TARGET_SSE2 static inline __m128i blend_channels_sse2(__m128i src16, __m128i dst16){
+    const __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(src16, 0xFF), 0xFF);
+    __m128i x = _mm_mullo_epi16(dst16, _mm_sub_epi16(_mm_set1_epi16(255), alpha));
+    x = _mm_add_epi16(x, _mm_set1_epi16(128));
+    x = _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+    return _mm_add_epi16(src16, x);
+}
+
+BLEND_TARGET_SSE2 static void blend_row_sse2(uint32_t* dst, const uint32_t* src, int n){
+    const __m128i zero = _mm_setzero_si128();
+    int i = 0;
+    for(; i + 4 <= n; i+=4){
+        const __m128i s = _mm_loadu_si128((const __m128i*) &src[i]);
+        const __m128i d = _mm_loadu_si128((const __m128i*) &dst[i]);
+        const __m128i lo = blend_channels_sse2(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero));
+        const __m128i hi = blend_channels_sse2(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero));
+        _mm_storeu_si128((__m128i*) &dst[i], _mm_packus_epi16(lo, hi));
+    }
+    blend_row_scalar(&dst[i], &src[i], n - i);
+}
+
+BLEND_TARGET_AVX2 static inline __m256i blend_channels_avx2(__m256i src16, __m256i dst16){
+    const __m256i alpha = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(src16, 0xFF), 0xFF);
+    __m256i x = _mm256_mullo_epi16(dst16, _mm256_sub_epi16(_mm256_set1_epi16(255), alpha));
+    x = _mm256_add_epi16(x, _mm256_set1_epi16(128));
+    x = _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+    return _mm256_add_epi16(src16, x);
+}
+
+// unpack and pack both work per 128 bit lane so the pixel order survives the round trip
+BLEND_TARGET_AVX2 static void blend_row_avx2(uint32_t* dst, const uint32_t* src, int n){
+    const __m256i zero = _mm256_setzero_si256();
+    int i = 0;
+    for(; i + 8 <= n; i+=8){
+        const __m256i s = _mm256_loadu_si256((const __m256i*) &src[i]);
+        const __m256i d = _mm256_loadu_si256((const __m256i*) &dst[i]);
+        const __m256i lo = blend_channels_avx2(_mm256_unpacklo_epi8(s, zero), _mm256_unpacklo_epi8(d, zero));
+        const __m256i hi = blend_channels_avx2(_mm256_unpackhi_epi8(s, zero), _mm256_unpackhi_epi8(d, zero));
+        _mm256_storeu_si256((__m256i*) &dst[i], _mm256_packus_epi16(lo, hi));
+    }
+    // gcc turns the call below into a jump without clearing the upper halves,
+    // which slows every legacy sse instruction that runs after this
+    _mm256_zeroupper();
+    blend_row_sse2(&dst[i], &src[i], n - i);
+}
+
+static int cpu_has_avx2(void){
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 0);
+    if(info[0] < 7) return 0;
+    __cpuid(info, 1);
+    // the os has to save the ymm registers too
+    if(!(info[2] & (1 << 27)) || !(info[2] & (1 << 28))) return 0;
+    if((_xgetbv(0) & 6) != 6) return 0;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+static int cpu_has_sse2(void){
+#if defined(__x86_64__) || defined(_M_X64)
+    return 1;
+#elif defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[3] & (1 << 26)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2");
+#endif
+}
+
+#endif // BLEND_X86
+
+static void blend_row_dispatch(uint32_t* dst, const uint32_t* src, int n);
+
+// the widest kernel the cpu supports, picked on the first call
+static void (*blend_row)(uint32_t* dst, const uint32_t* src, int n) = blend_row_dispatch;
+
+static const char* blend_row_name = "scalar";
+
+static void blend_row_dispatch(uint32_t* dst, const uint32_t* src, int n){
+#ifdef BLEND_X86
+    if(cpu_has_avx2()){
+        blend_row = blend_row_avx2;
+        blend_row_name = "avx2";
+    }
+    else if(cpu_has_sse2()){
+        blend_row = blend_row_sse2;
+        blend_row_name = "sse2";
+    }
+    else
+#endif
+    {
+        blend_row = blend_row_scalar;
+        blend_row_name = "scalar";
+    }
+    blend_row(dst, src, n);
+}
+
+// the channels of color scaled by the ones of factors, a factor of 255 keeps the channel as it is
+static inline uint32_t scale_color(const uint32_t color, const uint32_t factors){
+    uint32_t o = 0;
+    for(int c = 0; c < 32; c+=8) o |= div255(((color >> c) & 0xFF) * ((factors >> c) & 0xFF)) << c;
+    return o;
+}
+
+// blends n src pixels scaled by factors over n dst pixels
+static void blend_scaled_row_scalar(uint32_t* dst, const uint32_t* src, int n, uint32_t factors){
+    for(int i = 0; i < n; i+=1) dst[i] = blend_colors(scale_color(src[i], factors), dst[i]);
+}
+
+#ifdef BLEND_X86
+
+// div255(src16 * factors16) on 16 bit channels, the product fits since both are at most 255
+BLEND_TARGET_SSE2 static inline __m128i scale_channels_sse2(__m128i src16, __m128i factors16){
+    __m128i x = _mm_add_epi16(_mm_mullo_epi16(src16, factors16), _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+BLEND_TARGET_SSE2 static void blend_scaled_row_sse2(uint32_t* dst, const uint32_t* src, int n, uint32_t factors){
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i f = _mm_unpacklo_epi8(_mm_set1_epi32((int) factors), zero);
+    int i = 0;
+    for(; i + 4 <= n; i+=4){
+        const __m128i s = _mm_loadu_si128((const __m128i*) &src[i]);
+        const __m128i d = _mm_loadu_si128((const __m128i*) &dst[i]);
+        const __m128i lo = blend_channels_sse2(scale_channels_sse2(_mm_unpacklo_epi8(s, zero), f), _mm_unpacklo_epi8(d, zero));
+        const __m128i hi = blend_channels_sse2(scale_channels_sse2(_mm_unpackhi_epi8(s, zero), f), _mm_unpackhi_epi8(d, zero));
+        _mm_storeu_si128((__m128i*) &dst[i], _mm_packus_epi16(lo, hi));
+    }
+    blend_scaled_row_scalar(&dst[i], &src[i], n - i, factors);
+}
+
+BLEND_TARGET_AVX2 static inline __m256i scale_channels_avx2(__m256i src16, __m256i factors16){
+    __m256i x = _mm256_add_epi16(_mm256_mullo_epi16(src16, factors16), _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+}
+
+BLEND_TARGET_AVX2 static void blend_scaled_row_avx2(uint32_t* dst, const uint32_t* src, int n, uint32_t factors){
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i f = _mm256_unpacklo_epi8(_mm256_set1_epi32((int) factors), zero);
+    int i = 0;
+    for(; i + 8 <= n; i+=8){
+        const __m256i s = _mm256_loadu_si256((const __m256i*) &src[i]);
+        const __m256i d = _mm256_loadu_si256((const __m256i*) &dst[i]);
+        const __m256i lo = blend_channels_avx2(scale_channels_avx2(_mm256_unpacklo_epi8(s, zero), f), _mm256_unpacklo_epi8(d, zero));
+        const __m256i hi = blend_channels_avx2(scale_channels_avx2(_mm256_unpackhi_epi8(s, zero), f), _mm256_unpackhi_epi8(d, zero));
+        _mm256_storeu_si256((__m256i*) &dst[i], _mm256_packus_epi16(lo, hi));
+    }
+    _mm256_zeroupper();
+    blend_scaled_row_sse2(&dst[i], &src[i], n - i, factors);
+}
+
+#endif // BLEND_X86
+
+static void blend_scaled_row_dispatch(uint32_t* dst, const uint32_t* src, int n, uint32_t factors);
+
+static void (*blend_scaled_row)(uint32_t* dst, const uint32_t* src, int n, uint32_t factors) = blend_scaled_row_dispatch;
+
+static void blend_scaled_row_dispatch(uint32_t* dst, const uint32_t* src, int n, uint32_t factors){
+#ifdef BLEND_X86
+    if(cpu_has_avx2())      blend_scaled_row = blend_scaled_row_avx2;
+    else if(cpu_has_sse2()) blend_scaled_row = blend_scaled_row_sse2;
+    else
+#endif
+    blend_scaled_row = blend_scaled_row_scalar;
+    blend_scaled_row(dst, src, n, factors);
+}
+
+// brightness with the 0.2126, 0.7152, 0.0722 weights rounded down, 0 for a fully transparent color
+static inline uint8_t luminance_color(const uint32_t color){
+    if(!(color >> 24)) return 0;
+    return (uint8_t) ((2126 * ((color >> 0) & 0xFF) + 7152 * ((color >> 8) & 0xFF) + 722 * ((color >> 16) & 0xFF)) / 10000);
+}
+
+static void luminance_row_scalar(uint8_t* dst, const uint32_t* src, int n){
+    for(int i = 0; i < n; i+=1) dst[i] = luminance_color(src[i]);
+}
+
+#ifdef BLEND_X86
+
+// x / 10000 as (x * 6871948) >> 36, exact for every x below 21053760 and the weighted sum is at most 2550000
+BLEND_TARGET_SSE2 static inline __m128i luminance_sse2(__m128i colors){
+    const __m128i mask = _mm_set1_epi32(0x00FF00FF);
+    // 16 bit pairs (r, b) and (g, a) so madd does the weighted sum
+    const __m128i rb = _mm_and_si128(colors, mask);
+    const __m128i ga = _mm_and_si128(_mm_srli_epi32(colors, 8), mask);
+    const __m128i sum = _mm_add_epi32(
+        _mm_madd_epi16(rb, _mm_set1_epi32(2126 | (722 << 16))),
+        _mm_madd_epi16(ga, _mm_set1_epi32(7152))
+    );
+    const __m128i m = _mm_set1_epi32(6871948);
+    const __m128i even = _mm_srli_epi64(_mm_mul_epu32(sum, m), 36);
+    const __m128i odd  = _mm_srli_epi64(_mm_mul_epu32(_mm_srli_epi64(sum, 32), m), 36);
+    const __m128i luminance = _mm_or_si128(even, _mm_slli_epi64(odd, 32));
+    const __m128i transparent = _mm_cmpeq_epi32(_mm_srli_epi32(colors, 24), _mm_setzero_si128());
+    return _mm_andnot_si128(transparent, luminance);
+}
+
+BLEND_TARGET_SSE2 static void luminance_row_sse2(uint8_t* dst, const uint32_t* src, int n){
+    int i = 0;
+    for(; i + 8 <= n; i+=8){
+        const __m128i lo = luminance_sse2(_mm_loadu_si128((const __m128i*) &src[i]));
+        const __m128i hi = luminance_sse2(_mm_loadu_si128((const __m128i*) &src[i + 4]));
+        const __m128i words = _mm_packs_epi32(lo, hi);
+        _mm_storel_epi64((__m128i*) &dst[i], _mm_packus_epi16(words, words));
+    }
+    luminance_row_scalar(&dst[i], &src[i], n - i);
+}
+
+#endif // BLEND_X86
+
+static void luminance_row_dispatch(uint8_t* dst, const uint32_t* src, int n);
+
+static void (*luminance_row)(uint8_t* dst, const uint32_t* src, int n) = luminance_row_dispatch;
+
+static void luminance_row_dispatch(uint8_t* dst, const uint32_t* src, int n){
+#ifdef BLEND_X86
+    if(cpu_has_sse2()) luminance_row = luminance_row_sse2;
+    else
+#endif
+    luminance_row = luminance_row_scalar;
+    luminance_row(dst, src, n);
+}
+
+#endif // =====================  END OF FILE BLEND_H ===========================
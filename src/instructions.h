@@ -55,6 +55,8 @@ enum Instructions {
   INST_LOAD,
   INST_QUERY,
   INST_HELP,
+  INST_EXPORT,
+  INST_STYLE,
 
   // for counting purposes
   INST_COUNT
@@ -87,7 +89,9 @@ static char single_char_cmd[INST_COUNT] = {
     [INST_SAVE] = 'v',
     [INST_LOAD] = '^',
     [INST_QUERY] = '%',
-    [INST_HELP] = '?'
+    [INST_HELP] = '?',
+    [INST_EXPORT] = 'x',
+    [INST_STYLE] = '*'
 };
 
 
@@ -152,6 +156,8 @@ int get_instruction(const char *what) {
     if(cmp_str(what, "load"))                           return INST_LOAD       ;
     if(cmp_str(what, "query"))                          return INST_QUERY    ;
     if(cmp_str(what, "help"))                           return INST_HELP       ;
+    if(cmp_str(what, "export"))                         return INST_EXPORT     ;
+    if(cmp_str(what, "style"))                          return INST_STYLE      ;
 
     return INST_NONE;
 }
@@ -200,7 +206,7 @@ int show(const char* what, int iwhat, int skip_questions){
             tileset_path,
             tileset_tilew, tileset_tileh,
             ascii_map,
-            (display == render_graphical)? "graphics" : "character"
+            get_display_name()
         );
         for(TILE i = 0; i < sizeof(tile_mapping) / sizeof(tile_mapping[0]); i+=1){
             if(is_tile_mapped(i)){
@@ -242,7 +248,7 @@ int show(const char* what, int iwhat, int skip_questions){
                 printf("\ttile %i maps to %i\n", iwhat, real_tile);
                 iwhat = real_tile;
             }
-            if(tileset){
+            if(tileset_path && !wait_tileset()){
                 if(iwhat <= 0) return 0;
                 const int tilex = ((iwhat - 1) % (tilesetx / tileset_tilew));
                 const int tiley = ((iwhat - 1) / (tilesetx / tileset_tilew));
@@ -257,13 +263,10 @@ int show(const char* what, int iwhat, int skip_questions){
                     draw_tile = get_first_char_in_line();
                 }
                 if(draw_tile == 'y' || draw_tile == 'a'){
-                    const int toffset = tiley * tileset_tileh * tilesetx + tilex * tileset_tilew;
+                    const uint32_t* const sprite = get_tile_sprite(&tileset_mips[0], iwhat);
                     for(int i = 0; i < tileset_tileh; i+=1){
                         for(int j = 0; j < tileset_tilew; j+=1){
-                            uint32_t color = 0;
-                            for(int channel = 0; channel < tileset_comp; channel+=1){
-                                color |= (tileset[(toffset + i * tilesetx + j) * tileset_comp + channel]) << (channel * 8);
-                            }
+                            const uint32_t color = unpremultiply_color(sprite[i * tileset_tilew + j]);
                             if(draw_tile == 'y')
                                 put_color_char(color);
                             else
@@ -282,19 +285,13 @@ int show(const char* what, int iwhat, int skip_questions){
 
     if(cmp_str(what, "map")){
         if(output != stdout) display(0);
-        FILE* const output_temp = output;
-        output = stdout;
-        print_map(0);
-        output = output_temp;
+        print_map_terminal(0);
         printf("map: %s    mapw = %i    maph = %i\n", map_path, mapw, maph);
         return 0;
     }
     if(cmp_str(what, "mapf")){
         if(output != stdout) display(1);
-        FILE* const output_temp = output;
-        output = stdout;
-        print_map(1);
-        output = output_temp;
+        print_map_terminal(1);
         printf("map: %s    mapw = %i    maph = %i\n", map_path, mapw, maph);
         return 0;
     }
@@ -334,17 +331,29 @@ int show(const char* what, int iwhat, int skip_questions){
         return 0;
     }
     if(cmp_str(what, "mode") || cmp_str(what, "output") || cmp_str(what, "ascii")){
+        finish_file_frames();
         printf(
             "output: %s\n"
             "ascii: %s\n"
-            "draw mode: %s\n",
+            "draw mode: %s\n"
+            "terminal colors: %s\n"
+            "unchanged frames skipped: %i\n"
+            "frames replaced before drawn: %i\n"
+            "render threads: %i\n"
+            "max frame: %ix%i\n",
             output_path? output_path : "stdout",
             ascii_map,
-            (display == render_graphical)? "graphical" : "character"
+            get_display_name(),
+            term_256_colors? "256" : "24 bit",
+            skipped_frames,
+            get_coalesced_frames(),
+            (render_threads > 0)? render_threads : get_cpu_count(),
+            max_framew, max_frameh
         );
         return 0;
     }
     if(cmp_str(what, "tilesheet")){
+        if(tileset_path) wait_tileset();
         printf(
             "tileset: %s\n"
             "    tilesetw = %i, tileseth =%i\n"
@@ -356,7 +365,7 @@ int show(const char* what, int iwhat, int skip_questions){
             tilesetx / tileset_tilew, tilesetx / tileset_tileh
         );
         int draw_tileset = 0;
-        if(!skip_questions &&  tileset != NULL){
+        if(!skip_questions &&  tileset_sprites != NULL){
             printf("do you wish to draw the tilesheet[y/n]?\n");
             draw_tileset = get_yes_or_no_answer();
         }
@@ -366,12 +375,9 @@ int show(const char* what, int iwhat, int skip_questions){
             for(int tiley = 0; tiley < tileset_tileycount; tiley+=1){
                 for(int i = 0; i < tileset_tileh; i+=1){
                     for(int tilex = 0; tilex < tileset_tilexcount; tilex+=1){
-                        const int toffset = tiley * tileset_tileh * tilesetx + tilex * tileset_tilew;
+                        const uint32_t* const sprite = get_tile_sprite(&tileset_mips[0], tiley * tileset_tilexcount + tilex + 1);
                         for(int j = 0; j < tileset_tilew; j+=1){
-                            uint32_t color = 0;
-                            for(int channel = 0; channel < tileset_comp; channel+=1){
-                                color = (color << 8) | (tileset[(toffset + i * tilesetx + j) * tileset_comp + channel]);
-                            }
+                            const uint32_t color = unpremultiply_color(sprite[i * tileset_tilew + j]);
                             putchar((int) ascii_map[getascii_color_index(color)]);
                         }
                     }
@@ -575,6 +581,8 @@ static int query(int old, int _new, int query){
 
     if(!query){
 
+        mark_map_dirty(0, 0, mapw, maph);
+
         for(int l = 0; l < layers; l+=1){
             for(int i = 0; i < maph; i+=1){
                 for(int j = 0; j < mapw; j+=1){
@@ -643,6 +651,7 @@ static int query(int old, int _new, int query){
                 if(map[l][i * mapw + j] == old){
                     if(!query){
                         map[l][i * mapw + j] = _new;
+                        mark_map_dirty(j, i, 1, 1);
                         count += 1;
                         continue;
                     }
@@ -669,6 +678,7 @@ static int query(int old, int _new, int query){
                         query = 0;
                     default:
                         map[l][i * mapw + j] = _new;
+                        mark_map_dirty(j, i, 1, 1);
                         count += 1;
                     case 'n':
                     case 's':
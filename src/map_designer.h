@@ -29,6 +29,7 @@ SOFTWARE.
 #include <stdlib.h>
 #include <stdint.h>
 #include <inttypes.h>
+#include <string.h>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
@@ -36,6 +37,9 @@ SOFTWARE.
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "stb_image_write.h"
 
+#include "platform.h"
+#include "blend.h"
+
 #ifndef TILE
     #define TILE unsigned int
 #endif
@@ -86,16 +90,113 @@ static FILE* output;
 static void (*display)(int);
 
 static const char* tileset_path;
-static stbi_uc* tileset;
 static int tileset_tilew;
 static int tileset_tileh;
 static int tilesetx;
 static int tilesety;
-static int tileset_comp;
 
+// the tilesheet expanded once at load to premultiplied 0xAABBGGRR sprites, one tileset_tilew * tileset_tileh block per tile
+static uint32_t*  tileset_sprites;
+static int        tileset_tile_count;
+// tile id -> sprite, tile 0 and the ids that aren't in the tilesheet point to the missing tile sprite
+static uint32_t** tileset_sprite_lut;
+static uint32_t*  tileset_missing_sprite;
+
+enum TileOpacity {
+    TILE_TRANSPARENT = 0,
+    TILE_MIXED,
+    TILE_OPAQUE
+};
+
+// tile id -> TileOpacity, indexed like tileset_sprite_lut
+static uint8_t*   tileset_opacity;
+
+// tile id -> the premultiplied average of its sprite's pixels, what a cell looks like from far away
+static uint32_t*  tileset_average_colors;
+
+// box filtered copies of the sprites at 1/2, 1/4 and 1/8 of their size, for cameras too wide to draw them whole,
+// level 0 is the tileset itself and the levels stop early once a sprite is down to a single pixel
+#define TILESET_MIP_LEVELS 4
+
+typedef struct SpriteMip {
+    // tile id -> sprite, indexed like tileset_sprite_lut
+    uint32_t** lut;
+    // the sprites of every id, the missing tile first, owned by the levels past 0
+    uint32_t*  sprites;
+    int        tilew;
+    int        tileh;
+} SpriteMip;
+
+static SpriteMip  tileset_mips[TILESET_MIP_LEVELS];
+static int        tileset_mip_count = 0;
+
+// the ascii glyph of every sprite pixel, indexed like tileset_sprite_lut with one tileset_tilew * tileset_tileh block per id,
+// built for the ascii map in tileset_glyphs_map and only used for opaque tiles, since the others depend on what's under them
+static char*       tileset_glyphs;
+static const char* tileset_glyphs_map;
+static int         tileset_glyphs_len;
+
+// the sprites are cached next to the tilesheet (<tilesheet>.cache) keyed by the hash of the tilesheet file,
+// so later launches just map the cache instead of decoding the png again
+#define TILESET_CACHE_MAGIC   0x5354444D
+#define TILESET_CACHE_VERSION 3
+
+typedef struct TilesetCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t source_hash;
+    int32_t  w;
+    int32_t  h;
+    int32_t  tilew;
+    int32_t  tileh;
+    int32_t  tile_count;
+    int32_t  reserved;
+} TilesetCacheHeader;
+
+typedef struct TilesetLoad {
+    const char* path;
+    int         tilew;
+    int         tileh;
+    uint32_t*   sprites;
+    uint8_t*    opacity;
+    int         w;
+    int         h;
+    int         tile_count;
+    MappedFile  cache;
+} TilesetLoad;
+
+static TilesetLoad tileset_load;
+static Thread      tileset_loader;
+static int         tileset_pending = 0;
+
+// the graphical renderer's framebuffer, kept between displays and only reallocated when it needs to grow
 static uint32_t* pixels;
 static int       pixelsw;
 static int       pixelsh;
+static size_t    pixels_cap;
+// frames whose sprites would make them bigger than this are drawn with the downscaled sprites,
+// or from the overview at a pixel per cell or less when even those don't fit
+static int       max_framew = 4096;
+static int       max_frameh = 4096;
+
+// the tiles every cell of the framebuffer was drawn from, the layers that can show from the top down,
+// the next frame keeps the cells whose tiles are the same, shifted into place first if the camera moved
+static TILE*           drawn_cells;
+static TILE*           next_cells;
+static size_t          drawn_cells_cap;
+static int             drawn_valid = 0;
+static int             drawn_i0;
+static int             drawn_j0;
+// the cells the map covered, the rest of the framebuffer is black
+static int             drawn_rows;
+static int             drawn_columns;
+static int             drawn_cameraw;
+static int             drawn_camerah;
+static int             drawn_depth;
+static const uint32_t* drawn_sprites;
+static unsigned int    drawn_styles_version;
+// whether the layer styles were applied, a frame of the current layer alone never has them
+static int             drawn_styled;
 
 static int cursorx;
 static int cursory;
@@ -104,6 +205,149 @@ static int active = 0;
 
 static int changed_since_last_save = 0;
 
+// a rect of map cells, none when x0 >= x1
+typedef struct DirtyRect {
+    int x0;
+    int y0;
+    int x1;
+    int y1;
+} DirtyRect;
+
+// the cells changed since the overview and the composite were last brought up to date
+static DirtyRect overview_dirty;
+static DirtyRect composite_dirty;
+
+// what all the layers of a map cell add up to, kept for the whole map by update_composite
+// so the frames that show every layer don't have to go through them
+typedef struct CompositeCell {
+    // the layers with a tile other than 0
+    uint16_t count;
+    // the layers that can show from the top down, the last one is the topmost opaque tile unless it's every layer
+    uint16_t depth;
+} CompositeCell;
+
+static CompositeCell* composite_cells;
+static int            composite_w;
+static int            composite_h;
+static int            composite_layers;
+// whether the depths were found with the tileset's opacities, without a tileset every layer can show
+static int            composite_opacity;
+static int            composite_valid = 0;
+static unsigned int   composite_styles_version;
+
+// how a layer looks in the frames that show every layer, the current layer on its own is always drawn as it is
+typedef struct LayerStyle {
+    int      visible;
+    // 0 up to 255
+    uint8_t  opacity;
+    // 0xBBGGRR, the sprites' colors are multiplied by it
+    uint32_t tint;
+    // the 0xAABBGGRR factors for blend_scaled_row the opacity and the tint come down to
+    uint32_t factors;
+} LayerStyle;
+
+#define LAYER_STYLE_PLAIN 0xFFFFFFFF
+
+// a style per layer once any layer has one, NULL while every layer is drawn as it is
+static LayerStyle*  layer_styles;
+static int          layer_style_count = 0;
+// bumped whenever what any layer looks like changes, so whatever was drawn with the old styles is drawn again
+static unsigned int layer_styles_version = 0;
+
+static void set_layer_style_fields(LayerStyle* style, int visible, uint8_t opacity, uint32_t tint){
+    style->visible = visible;
+    style->opacity = opacity;
+    style->tint    = tint & 0xFFFFFF;
+    style->factors = (uint32_t) opacity << 24;
+    for(int c = 0; c < 24; c+=8) style->factors |= div255(((tint >> c) & 0xFF) * opacity) << c;
+}
+
+static void free_layer_styles(void){
+    free(layer_styles);
+    layer_styles = NULL;
+    layer_style_count = 0;
+    layer_styles_version += 1;
+}
+
+// \returns the styles of the layers, NULL if every layer is drawn as it is
+static const LayerStyle* get_layer_styles(void){
+    return (layer_styles && layer_style_count == layers)? layer_styles : NULL;
+}
+
+// sets the style of layer, the styles are dropped once no layer has one
+// \returns 0 on success
+static int set_layer_style(int layer, int visible, uint8_t opacity, uint32_t tint){
+    if(!layer_styles){
+        layer_styles = malloc(layers * sizeof(layer_styles[0]));
+        if(!layer_styles) return 1;
+        layer_style_count = layers;
+        for(int k = 0; k < layers; k+=1) set_layer_style_fields(&layer_styles[k], 1, 255, 0xFFFFFF);
+    }
+    set_layer_style_fields(&layer_styles[layer], visible, opacity, tint);
+    layer_styles_version += 1;
+    for(int k = 0; k < layer_style_count; k+=1){
+        if(!layer_styles[k].visible || layer_styles[k].factors != LAYER_STYLE_PLAIN) return 0;
+    }
+    free_layer_styles();
+    return 0;
+}
+
+// keeps the styles in step with a layer that was just added at layer
+static void insert_layer_style(int layer){
+    if(!layer_styles) return ;
+    LayerStyle* const styles = realloc(layer_styles, (layer_style_count + 1) * sizeof(styles[0]));
+    if(!styles){
+        fprintf(stderr, "[ERROR] could not keep the layer styles, every layer is drawn as it is now\n");
+        free_layer_styles();
+        return ;
+    }
+    layer_styles = styles;
+    memmove(&styles[layer + 1], &styles[layer], (layer_style_count - layer) * sizeof(styles[0]));
+    set_layer_style_fields(&styles[layer], 1, 255, 0xFFFFFF);
+    layer_style_count += 1;
+    layer_styles_version += 1;
+}
+
+// keeps the styles in step with the layer that was just removed from layer
+static void remove_layer_style(int layer){
+    if(!layer_styles) return ;
+    memmove(&layer_styles[layer], &layer_styles[layer + 1], (layer_style_count - layer - 1) * sizeof(layer_styles[0]));
+    layer_style_count -= 1;
+    layer_styles_version += 1;
+}
+
+static void swap_layer_styles(int first, int second){
+    if(!layer_styles) return ;
+    const LayerStyle style = layer_styles[first];
+    layer_styles[first] = layer_styles[second];
+    layer_styles[second] = style;
+    layer_styles_version += 1;
+}
+
+// adds the cells x0 up to x1 and y0 up to y1 to rect, they have to be inside the map
+static void add_dirty_rect(DirtyRect* rect, int x0, int y0, int x1, int y1){
+    if(rect->x0 < rect->x1 && rect->y0 < rect->y1){
+        if(rect->x0 < x0) x0 = rect->x0;
+        if(rect->y0 < y0) y0 = rect->y0;
+        if(rect->x1 > x1) x1 = rect->x1;
+        if(rect->y1 > y1) y1 = rect->y1;
+    }
+    rect->x0 = x0;
+    rect->y0 = y0;
+    rect->x1 = x1;
+    rect->y1 = y1;
+}
+
+static void mark_map_dirty(int x, int y, int w, int h){
+    const int x1 = (x + w < mapw)? x + w : mapw;
+    const int y1 = (y + h < maph)? y + h : maph;
+    if(x < 0) x = 0;
+    if(y < 0) y = 0;
+    if(x >= x1 || y >= y1) return ;
+    add_dirty_rect(&overview_dirty, x, y, x1, y1);
+    add_dirty_rect(&composite_dirty, x, y, x1, y1);
+}
+
 static TILE tile_mapping[32];
 
 static uint32_t __is_tile_mapped = 0;
@@ -116,6 +360,13 @@ static inline TILE get_real_tile(TILE tile){
     return is_tile_mapped(tile)? tile_mapping[tile] : tile;
 }
 
+// tile -> palette symbol as print_map shows it, following the tile mappings,
+// rebuilt before a frame whenever the mappings or the palette changed
+#define TILE_SYMBOLS_LEN 256
+
+static char tile_symbols[TILE_SYMBOLS_LEN];
+static int  tile_symbols_dirty = 1;
+
 static inline int map_tile(TILE key, TILE value){
     if(key >= sizeof(tile_mapping) / sizeof(tile_mapping[0])){
         fprintf(stderr, "[ERROR] can not map tiles bigger than %i\n", (int) (sizeof(tile_mapping) / sizeof(tile_mapping[0])) - 1);
@@ -126,12 +377,105 @@ static inline int map_tile(TILE key, TILE value){
 
     tile_mapping[key] = value;
 
+    tile_symbols_dirty = 1;
+
     return 0;
 }
 
 static inline void unmap_tile(TILE key){
     if(key < sizeof(tile_mapping) / sizeof(tile_mapping[0]))
         __is_tile_mapped &= ~(1 << key);
+    tile_symbols_dirty = 1;
+}
+
+static void update_tile_symbols(void){
+    if(!tile_symbols_dirty) return ;
+    for(TILE tile = 0; tile < TILE_SYMBOLS_LEN; tile+=1)
+        tile_symbols[tile] = (tile < (TILE) palette_len)? palette[tile] : '~';
+    // backwards so the first mapped tile wins
+    for(int i = (int) (sizeof(tile_mapping) / sizeof(tile_mapping[0])) - 1; i > -1; i-=1){
+        if(is_tile_mapped(i) && tile_mapping[i] < TILE_SYMBOLS_LEN)
+            tile_symbols[tile_mapping[i]] = (i < palette_len)? palette[i] : '~';
+    }
+    tile_symbols_dirty = 0;
+}
+
+// everything a frame is drawn from: the camera, the tiles it sees and how print_map shows them,
+// either the live map or a snapshot of it, in which case tiles[k] only holds the rows y0 and on
+// and the columns x0 up to x0 + stride of layer k, so tiles are read with get_view_tile
+typedef struct FrameView {
+    TILE* const* tiles;
+    int          x0;
+    int          y0;
+    int          stride;
+    int          mapw;
+    int          maph;
+    int          layers;
+    int          current_layer;
+    int          camerax;
+    int          cameray;
+    int          cameraw;
+    int          camerah;
+    // TILE_SYMBOLS_LEN symbols, the bigger tiles are looked up in the mapping and the palette
+    const char*  symbols;
+    const TILE*  mapping;
+    uint32_t     mapped;
+    const char*  palette;
+    int          palette_len;
+    // the composite of the cells, indexed like the tiles of a layer, only there for frames that show every layer
+    const CompositeCell* composite;
+    // a style per layer for frames that show every layer, NULL if they're drawn as they are
+    const LayerStyle*    styles;
+    unsigned int         styles_version;
+    // the tileset_mips level the graphical frame is drawn with
+    int          sprite_level;
+    // set when the camera sees too many cells to draw their sprites, the frame is then the overview_w by overview_h pixels
+    // at overview_x, overview_y of an overview level that is overview_levelw by overview_levelh and overview_stride wide in memory
+    const uint32_t* overview;
+    int             overview_stride;
+    int             overview_levelw;
+    int             overview_levelh;
+    int             overview_x;
+    int             overview_y;
+    int             overview_w;
+    int             overview_h;
+} FrameView;
+
+static const CompositeCell* update_composite(void);
+
+// \returns the view of the map as it is now, with the composite if the frame shows all the layers
+static FrameView get_live_view(int all_layers){
+    update_tile_symbols();
+    const FrameView view = {
+        .tiles = (TILE* const*) map, .x0 = 0, .y0 = 0, .stride = mapw,
+        .mapw = mapw, .maph = maph, .layers = layers, .current_layer = current_layer,
+        .camerax = camerax, .cameray = cameray, .cameraw = cameraw, .camerah = camerah,
+        .symbols = tile_symbols, .mapping = tile_mapping, .mapped = __is_tile_mapped, .palette = palette, .palette_len = palette_len,
+        .composite = (all_layers)? update_composite() : NULL,
+        .styles = (all_layers)? get_layer_styles() : NULL, .styles_version = layer_styles_version,
+        // set_view_scale picks the sprite level or the overview
+        .sprite_level = 0, .overview = NULL
+    };
+    return view;
+}
+
+static inline TILE get_view_tile(const FrameView* view, int k, int i, int j){
+    return view->tiles[k][(size_t) (i - view->y0) * view->stride + (j - view->x0)];
+}
+
+// a tile shows the symbol of the first tile mapped to it, or its own
+static char find_tile_symbol(const FrameView* view, TILE tile){
+    for(TILE i = 0; i < sizeof(tile_mapping) / sizeof(tile_mapping[0]); i+=1){
+        if(view->mapping[i] == tile && (view->mapped & (1 << i))){
+            tile = i;
+            break;
+        }
+    }
+    return (tile < (TILE) view->palette_len)? view->palette[tile] : '~';
+}
+
+static inline char get_tile_symbol(const FrameView* view, TILE tile){
+    return (tile < TILE_SYMBOLS_LEN)? view->symbols[tile] : find_tile_symbol(view, tile);
 }
 
 static inline int is_png_extension(const char* path){
@@ -144,6 +488,468 @@ static inline int is_png_extension(const char* path){
     return 0;
 }
 
+// the image formats a display output can be, picked by the output's extension or a shm: prefix
+enum ImageFormat {
+    IMAGE_NONE = 0,
+    IMAGE_PNG,
+    IMAGE_BMP,
+    IMAGE_TGA,
+    IMAGE_PPM,
+    IMAGE_PAM,
+    IMAGE_QOI,
+    // a live framebuffer in shared memory instead of a file
+    IMAGE_SHM
+};
+
+static int get_image_format(const char* path){
+    if(!path) return IMAGE_NONE;
+    static const char* const extensions[] = {".png", ".bmp", ".tga", ".ppm", ".pam", ".qoi"};
+    int path_len = 0;
+    for(; path[path_len]; path_len+=1);
+    if(path_len < 4) return IMAGE_NONE;
+    if(path_len > 4 && !memcmp(path, "shm:", 4)) return IMAGE_SHM;
+    for(int i = 0; i < (int) (sizeof(extensions) / sizeof(extensions[0])); i+=1){
+        if(!memcmp(&path[path_len - 4], extensions[i], 4)) return IMAGE_PNG + i;
+    }
+    return IMAGE_NONE;
+}
+
+// FNV-1a over the whole file
+// \returns 0 on success
+static int hash_file(const char* path, uint64_t* hash){
+    FILE* f = fopen(path, "rb");
+    if(!f) return 1;
+    uint64_t h = 0xcbf29ce484222325ULL;
+    unsigned char chunk[1 << 16];
+    for(size_t n = fread(chunk, 1, sizeof(chunk), f); n > 0; n = fread(chunk, 1, sizeof(chunk), f)){
+        for(size_t i = 0; i < n; i+=1){
+            h = (h ^ chunk[i]) * 0x100000001b3ULL;
+        }
+    }
+    fclose(f);
+    *hash = h;
+    return 0;
+}
+
+// a fast non cryptographic hash, only used to tell frames apart,
+// four independent lanes so the multiplies don't wait on each other
+static uint64_t hash_bytes(const void* data, size_t size){
+    const uint8_t* const bytes = (const uint8_t*) data;
+    const uint64_t k = 0xFF51AFD7ED558CCDull;
+    uint64_t lanes[4] = {0x9E3779B97F4A7C15ull, 0xC2B2AE3D27D4EB4Full, 0x165667B19E3779F9ull, 0x27D4EB2F165667C5ull};
+    size_t i = 0;
+    for(; i + 32 <= size; i+=32){
+        for(int l = 0; l < 4; l+=1){
+            uint64_t word;
+            memcpy(&word, &bytes[i + 8 * l], sizeof(word));
+            lanes[l] = (lanes[l] ^ word) * k;
+            lanes[l] ^= lanes[l] >> 32;
+        }
+    }
+    uint64_t hash = (uint64_t) size;
+    for(int l = 0; l < 4; l+=1) hash = (hash ^ lanes[l]) * k;
+    for(; i < size; i+=1) hash = (hash ^ bytes[i]) * 0x100000001B3ull;
+    return hash ^ (hash >> 29);
+}
+
+// \returns a malloced str1 followed by str2
+static char* concat_str(const char* str1, const char* str2){
+    int len1 = 0;
+    int len2 = 0;
+    for(; str1[len1]; len1+=1);
+    for(; str2[len2]; len2+=1);
+    char* const str = malloc(len1 + len2 + 1);
+    if(!str) return NULL;
+    for(int i = 0; i < len1; i+=1) str[i] = str1[i];
+    for(int i = 0; i <= len2; i+=1) str[len1 + i] = str2[i];
+    return str;
+}
+
+// the rounded average of the up to 2x2 pixels at 2 * i, 2 * j of a w by h image
+static inline uint32_t average_2x2(const uint32_t* src, int w, int h, int i, int j){
+    const int rows    = (2 * i + 1 < h)? 2 : 1;
+    const int columns = (2 * j + 1 < w)? 2 : 1;
+    const uint32_t count = rows * columns;
+    uint32_t sums[4] = {0};
+    for(int r = 0; r < rows; r+=1){
+        for(int c = 0; c < columns; c+=1){
+            const uint32_t color = src[(size_t) (2 * i + r) * w + 2 * j + c];
+            for(int channel = 0; channel < 4; channel+=1) sums[channel] += (color >> (8 * channel)) & 0xFF;
+        }
+    }
+    uint32_t color = 0;
+    for(int channel = 0; channel < 4; channel+=1) color |= ((sums[channel] + count / 2) / count) << (8 * channel);
+    return color;
+}
+
+// expands a decoded tilesheet with any channel count to premultiplied rgba sprites, tile after tile
+static uint32_t* build_tileset_sprites(const stbi_uc* sheet, int w, int h, int comp, int tilew, int tileh, int* tile_count){
+    const int tiles_per_row = w / tilew;
+    const int count = tiles_per_row * (h / tileh);
+    *tile_count = count;
+    if(count <= 0) return NULL;
+
+    uint32_t* const sprites = malloc((size_t) count * tilew * tileh * sizeof(sprites[0]));
+    if(!sprites) return NULL;
+
+    for(int tile = 0; tile < count; tile+=1){
+        uint32_t* sprite = &sprites[(size_t) tile * tilew * tileh];
+        const int tileoffset = (tile / tiles_per_row) * tileh * w + (tile % tiles_per_row) * tilew;
+        for(int i = 0; i < tileh; i+=1){
+            const stbi_uc* src = &sheet[(size_t) (tileoffset + i * w) * comp];
+            for(int j = 0; j < tilew; j+=1){
+                uint32_t r, g, b, a;
+                switch (comp)
+                {
+                case 1:  r = g = b = src[0]; a = 255;    break;
+                case 2:  r = g = b = src[0]; a = src[1]; break;
+                case 3:  r = src[0]; g = src[1]; b = src[2]; a = 255;    break;
+                default: r = src[0]; g = src[1]; b = src[2]; a = src[3]; break;
+                }
+                r = (r * a + 127) / 255;
+                g = (g * a + 127) / 255;
+                b = (b * a + 127) / 255;
+                *sprite++ = (r << 0) | (g << 8) | (b << 16) | (a << 24);
+                src += comp;
+            }
+        }
+    }
+    return sprites;
+}
+
+// \returns a malloced TileOpacity per sprite
+static uint8_t* classify_tileset_sprites(const uint32_t* sprites, int tile_count, int sprite_size){
+    uint8_t* const opacity = malloc(tile_count);
+    if(!opacity) return NULL;
+    for(int tile = 0; tile < tile_count; tile+=1){
+        uint32_t all = 0xFFFFFFFF;
+        uint32_t any = 0;
+        for(int i = 0; i < sprite_size; i+=1){
+            all &= sprites[i];
+            any |= sprites[i];
+        }
+        sprites += sprite_size;
+        opacity[tile] = ((all >> 24) == 0xFF)? TILE_OPAQUE : ((any >> 24) == 0)? TILE_TRANSPARENT : TILE_MIXED;
+    }
+    return opacity;
+}
+
+static void* load_tileset_job(void* arg){
+    TilesetLoad* const load = arg;
+
+    load->sprites = NULL;
+    load->opacity = NULL;
+
+    char* const cache_path = concat_str(load->path, ".cache");
+    char* const temp_path  = concat_str(load->path, ".cache.tmp");
+
+    uint64_t hash = 0;
+    const int hashed = cache_path && temp_path && hash_file(load->path, &hash) == 0;
+
+    if(hashed && map_file(&load->cache, cache_path) == 0){
+        const TilesetCacheHeader* const header = load->cache.data;
+        if(
+            load->cache.size >= sizeof(*header) &&
+            header->magic == TILESET_CACHE_MAGIC && header->version == TILESET_CACHE_VERSION &&
+            header->source_hash == hash && header->tilew == load->tilew && header->tileh == load->tileh &&
+            header->tile_count > 0 &&
+            load->cache.size == sizeof(*header) + (size_t) header->tile_count * (header->tilew * header->tileh * sizeof(uint32_t) + 1)
+        ){
+            load->w = header->w;
+            load->h = header->h;
+            load->tile_count = header->tile_count;
+            load->sprites = (uint32_t*) (header + 1);
+            load->opacity = (uint8_t*) &load->sprites[(size_t) header->tile_count * header->tilew * header->tileh];
+            goto defer;
+        }
+        unmap_file(&load->cache);
+    }
+
+    int comp = 0;
+    stbi_uc* const sheet = stbi_load(load->path, &load->w, &load->h, &comp, 0);
+    if(!sheet) goto defer;
+    load->sprites = build_tileset_sprites(sheet, load->w, load->h, comp, load->tilew, load->tileh, &load->tile_count);
+    stbi_image_free(sheet);
+    if(!load->sprites) goto defer;
+    load->opacity = classify_tileset_sprites(load->sprites, load->tile_count, load->tilew * load->tileh);
+    if(!load->opacity){
+        free(load->sprites);
+        load->sprites = NULL;
+        goto defer;
+    }
+
+    if(hashed){
+        // written aside and renamed so a concurrent launch never maps a half written cache
+        FILE* f = fopen(temp_path, "wb");
+        if(f){
+            const TilesetCacheHeader header = {
+                .magic = TILESET_CACHE_MAGIC, .version = TILESET_CACHE_VERSION, .source_hash = hash,
+                .w = load->w, .h = load->h, .tilew = load->tilew, .tileh = load->tileh,
+                .tile_count = load->tile_count, .reserved = 0
+            };
+            const size_t size = (size_t) load->tile_count * load->tilew * load->tileh;
+            const int written =
+                fwrite(&header, sizeof(header), 1, f) == 1 &&
+                fwrite(load->sprites, sizeof(uint32_t), size, f) == size &&
+                fwrite(load->opacity, 1, load->tile_count, f) == (size_t) load->tile_count;
+            fclose(f);
+            if(written){
+                remove(cache_path);
+                if(rename(temp_path, cache_path)) remove(temp_path);
+            }
+            else remove(temp_path);
+        }
+    }
+
+    defer:
+    if(cache_path) free(cache_path);
+    if(temp_path)  free(temp_path);
+    return NULL;
+}
+
+static void free_tileset(void);
+
+static void free_tileset_mips(void){
+    for(int level = 1; level < tileset_mip_count; level+=1){
+        free(tileset_mips[level].lut);
+        free(tileset_mips[level].sprites);
+    }
+    memset(tileset_mips, 0, sizeof(tileset_mips));
+    tileset_mip_count = 0;
+}
+
+// halves the sprites of the level before until TILESET_MIP_LEVELS or single pixel sprites, tileset_sprite_lut has to be ready
+// \returns 0 on success, the levels built before a failure stay usable
+static int build_tileset_mips(void){
+    free_tileset_mips();
+    tileset_mips[0].lut     = tileset_sprite_lut;
+    tileset_mips[0].sprites = tileset_sprites;
+    tileset_mips[0].tilew   = tileset_tilew;
+    tileset_mips[0].tileh   = tileset_tileh;
+    tileset_mip_count = 1;
+    for(int level = 1; level < TILESET_MIP_LEVELS; level+=1){
+        const SpriteMip* const src = &tileset_mips[level - 1];
+        if(src->tilew == 1 && src->tileh == 1) break;
+        SpriteMip* const mip = &tileset_mips[level];
+        mip->tilew = (src->tilew + 1) / 2;
+        mip->tileh = (src->tileh + 1) / 2;
+        const size_t sprite_size = (size_t) mip->tilew * mip->tileh;
+        mip->lut = malloc((tileset_tile_count + 1) * sizeof(mip->lut[0]));
+        mip->sprites = malloc((tileset_tile_count + 1) * sprite_size * sizeof(mip->sprites[0]));
+        if(!mip->lut || !mip->sprites){
+            free(mip->lut);
+            free(mip->sprites);
+            memset(mip, 0, sizeof(*mip));
+            return 1;
+        }
+        for(int tile = 0; tile <= tileset_tile_count; tile+=1){
+            uint32_t* const sprite = &mip->sprites[tile * sprite_size];
+            for(int i = 0; i < mip->tileh; i+=1){
+                for(int j = 0; j < mip->tilew; j+=1) sprite[i * mip->tilew + j] = average_2x2(src->lut[tile], src->tilew, src->tileh, i, j);
+            }
+            mip->lut[tile] = sprite;
+        }
+        tileset_mip_count += 1;
+    }
+    return 0;
+}
+
+// starts decoding the tilesheet in the background, use wait_tileset before touching the tileset
+// \returns 0 on success
+static int request_tileset(const char* path){
+    FILE* const f = fopen(path, "rb");
+    if(!f) return 1;
+    fclose(f);
+
+    free_tileset();
+
+    tileset_load.path = path;
+    tileset_load.tilew = tileset_tilew;
+    tileset_load.tileh = tileset_tileh;
+    tileset_load.cache.data = NULL;
+    tileset_load.cache.size = 0;
+    tileset_load.cache.is_mapped = 0;
+    if(thread_start(&tileset_loader, load_tileset_job, &tileset_load)) load_tileset_job(&tileset_load);
+    tileset_pending = 1;
+    tileset_path = path;
+    return 0;
+}
+
+// blocks until a requested tilesheet is decoded
+// \returns 0 if the tileset is ready to use
+static int wait_tileset(void){
+    if(!tileset_pending) return tileset_sprites == NULL;
+
+    thread_join(&tileset_loader);
+    tileset_pending = 0;
+
+    const int sprite_size = tileset_load.tilew * tileset_load.tileh;
+    if(tileset_load.sprites){
+        tileset_sprite_lut = malloc((tileset_load.tile_count + 1) * sizeof(tileset_sprite_lut[0]));
+        tileset_missing_sprite = malloc(sprite_size * sizeof(tileset_missing_sprite[0]));
+        tileset_opacity = malloc(tileset_load.tile_count + 1);
+        tileset_average_colors = malloc((tileset_load.tile_count + 1) * sizeof(tileset_average_colors[0]));
+    }
+    if(!tileset_load.sprites || !tileset_sprite_lut || !tileset_missing_sprite || !tileset_opacity || !tileset_average_colors){
+        fprintf(stderr, "[ERROR] could not load tileset '%s'\n", tileset_load.path);
+        if(tileset_load.sprites){
+            if(tileset_load.cache.data) unmap_file(&tileset_load.cache);
+            else{
+                free(tileset_load.sprites);
+                free(tileset_load.opacity);
+            }
+        }
+        free(tileset_sprite_lut);
+        free(tileset_missing_sprite);
+        free(tileset_opacity);
+        free(tileset_average_colors);
+        tileset_sprite_lut = NULL;
+        tileset_missing_sprite = NULL;
+        tileset_opacity = NULL;
+        tileset_average_colors = NULL;
+        return 1;
+    }
+
+    tileset_sprites    = tileset_load.sprites;
+    tileset_tile_count = tileset_load.tile_count;
+    tilesetx           = tileset_load.w;
+    tilesety           = tileset_load.h;
+    tileset_tilew      = tileset_load.tilew;
+    tileset_tileh      = tileset_load.tileh;
+
+    for(int i = 0; i < sprite_size; i+=1) tileset_missing_sprite[i] = 0xFF0000FF;
+    tileset_sprite_lut[0] = tileset_missing_sprite;
+    for(int tile = 1; tile <= tileset_tile_count; tile+=1)
+        tileset_sprite_lut[tile] = &tileset_sprites[(size_t) (tile - 1) * sprite_size];
+
+    tileset_opacity[0] = TILE_OPAQUE;
+    for(int tile = 1; tile <= tileset_tile_count; tile+=1) tileset_opacity[tile] = tileset_load.opacity[tile - 1];
+    if(!tileset_load.cache.data) free(tileset_load.opacity);
+    tileset_load.opacity = NULL;
+
+    for(int tile = 0; tile <= tileset_tile_count; tile+=1){
+        const uint32_t* const sprite = tileset_sprite_lut[tile];
+        uint64_t sums[4] = {0};
+        for(int i = 0; i < sprite_size; i+=1){
+            for(int c = 0; c < 4; c+=1) sums[c] += (sprite[i] >> (8 * c)) & 0xFF;
+        }
+        uint32_t color = 0;
+        for(int c = 0; c < 4; c+=1) color |= (uint32_t) ((sums[c] + sprite_size / 2) / sprite_size) << (8 * c);
+        tileset_average_colors[tile] = color;
+    }
+    if(build_tileset_mips()) fprintf(stderr, "[ERROR] could not allocate the downscaled sprites of '%s'\n", tileset_load.path);
+
+    return 0;
+}
+
+static void free_tileset(void){
+    if(tileset_pending) wait_tileset();
+    if(tileset_sprites){
+        if(tileset_load.cache.data) unmap_file(&tileset_load.cache);
+        else free(tileset_sprites);
+        free(tileset_sprite_lut);
+        free(tileset_missing_sprite);
+        free(tileset_opacity);
+        free(tileset_average_colors);
+    }
+    free_tileset_mips();
+    free(tileset_glyphs);
+    tileset_glyphs = NULL;
+    tileset_glyphs_map = NULL;
+    tileset_sprites = NULL;
+    tileset_sprite_lut = NULL;
+    tileset_missing_sprite = NULL;
+    tileset_opacity = NULL;
+    tileset_average_colors = NULL;
+    tileset_tile_count = 0;
+    // the depths might have come from these opacities
+    composite_valid = 0;
+}
+
+static inline const uint32_t* get_tile_sprite(const SpriteMip* mip, TILE tile){
+    return mip->lut[(tile <= (TILE) tileset_tile_count)? tile : 0];
+}
+
+static inline int get_tile_opacity(TILE tile){
+    return tileset_opacity[(tile <= (TILE) tileset_tile_count)? tile : 0];
+}
+
+// the opacity of tile drawn on layer k with styles, which can be NULL
+static inline int get_layer_tile_opacity(const LayerStyle* styles, int k, TILE tile){
+    const int opacity = get_tile_opacity(tile);
+    if(!styles || opacity == TILE_TRANSPARENT) return opacity;
+    if(!styles[k].visible || !styles[k].opacity) return TILE_TRANSPARENT;
+    return (styles[k].opacity < 255)? TILE_MIXED : opacity;
+}
+
+static inline uint32_t get_tile_average_color(TILE tile){
+    return tileset_average_colors[(tile <= (TILE) tileset_tile_count)? tile : 0];
+}
+
+static void compose_cells(int x0, int y0, int x1, int y1){
+    const LayerStyle* const styles = get_layer_styles();
+    for(int i = y0; i < y1; i+=1){
+        CompositeCell* const row = &composite_cells[(size_t) i * mapw];
+        for(int j = x0; j < x1; j+=1){
+            const size_t cell = (size_t) i * mapw + j;
+            int count = 0;
+            int depth = 0;
+            for(int k = 0; k < layers; k+=1){
+                // a hidden layer is neither counted nor hides anything
+                if(styles && !styles[k].visible){
+                    depth += (depth == k);
+                    continue;
+                }
+                const TILE tile = map[k][cell];
+                count += (tile != 0);
+                if(depth == k && !(composite_opacity && get_layer_tile_opacity(styles, k, tile) == TILE_OPAQUE)) depth += 1;
+            }
+            // the topmost opaque tile is visible too
+            if(depth < layers) depth += 1;
+            row[j].count = (uint16_t) count;
+            row[j].depth = (uint16_t) depth;
+        }
+    }
+}
+
+// brings the composite up to date with the map, only going through the cells marked dirty since the last time
+// \returns the composite, NULL if it couldn't be allocated or there are too many layers to count
+static const CompositeCell* update_composite(void){
+    if(layers > 0xFFFF) return NULL;
+    const int opacity = tileset_sprites != NULL;
+    if(!composite_valid || composite_w != mapw || composite_h != maph || composite_layers != layers || composite_opacity != opacity
+        || composite_styles_version != layer_styles_version){
+        const size_t size = (size_t) mapw * maph;
+        if(size > (size_t) composite_w * composite_h || !composite_cells){
+            CompositeCell* const cells = realloc(composite_cells, (size + 1) * sizeof(cells[0]));
+            if(!cells){
+                fprintf(stderr, "[ERROR] could not allocate the layer composite\n");
+                return NULL;
+            }
+            composite_cells = cells;
+        }
+        composite_w = mapw;
+        composite_h = maph;
+        composite_layers = layers;
+        composite_opacity = opacity;
+        composite_styles_version = layer_styles_version;
+        composite_valid = 1;
+        add_dirty_rect(&composite_dirty, 0, 0, mapw, maph);
+    }
+    const DirtyRect dirty = composite_dirty;
+    if(dirty.x0 < dirty.x1 && dirty.y0 < dirty.y1) compose_cells(dirty.x0, dirty.y0, dirty.x1, dirty.y1);
+    composite_dirty.x0 = composite_dirty.x1 = 0;
+    composite_dirty.y0 = composite_dirty.y1 = 0;
+    return composite_cells;
+}
+
+static void free_composite(void){
+    free(composite_cells);
+    composite_cells = NULL;
+    composite_w = composite_h = 0;
+    composite_valid = 0;
+}
+
 static inline int cmp_str(const char* str1, const char* str2){
     if(!str1 || !str2) return 0;
     for(; *str1 && *str1 == *str2; str1+=1) str2 += 1;
@@ -159,6 +965,21 @@ static int parse_uint(const char* str){
     return (*str == '\0')? output : -1;
 }
 
+// \returns the 0xBBGGRR color of an RRGGBB hex string, optionally starting with #, or -1 if it isn't one
+static int parse_color(const char* str){
+    if(*str == '#') str += 1;
+    int rgb = 0;
+    int digits = 0;
+    for(; str[digits]; digits+=1){
+        const char c = str[digits];
+        const int value = (c >= '0' && c <= '9')? c - '0' : (c >= 'a' && c <= 'f')? c - 'a' + 10 : (c >= 'A' && c <= 'F')? c - 'A' + 10 : -1;
+        if(value < 0 || digits >= 6) return -1;
+        rgb = (rgb << 4) | value;
+    }
+    if(digits != 6) return -1;
+    return ((rgb >> 16) & 0xFF) | (rgb & 0xFF00) | ((rgb & 0xFF) << 16);
+}
+
 static inline int Mstrlen(const char* str){
     int len = 0;
     for(; str[len]; len+=1);
@@ -262,13 +1083,15 @@ int load_map(const char* path){
         }
 
         stbi_image_free(pixels);
+        mark_map_dirty(0, 0, mapw, maph);
+        free_layer_styles();
 
         if(map_path == path) return 0;
         int i = 0;
         for(; path[i]; i+=1);
         if(map_path) free(map_path);
         map_path = malloc(i + 1);
-        for(map_path[i + 1] = '\0'; i > -1; i-=1) map_path[i] = path[i];
+        for(; i > -1; i-=1) map_path[i] = path[i];
         return 0;
     }
 
@@ -368,13 +1191,15 @@ int load_map(const char* path){
     mapw = width;
     maph = height;
     layers = lyr;
+    mark_map_dirty(0, 0, mapw, maph);
+    free_layer_styles();
 
     if(map_path == path) return 0;
     int i = 0;
     for(; path[i]; i+=1);
     if(map_path) free(map_path);
     map_path = malloc(i + 1);
-    for(map_path[i + 1] = '\0'; i > -1; i-=1) map_path[i] = path[i];
+    for(; i > -1; i-=1) map_path[i] = path[i];
 
     defer:
     if(f) fclose(f);
@@ -419,7 +1244,7 @@ int save_map(const char* path){
         for(; path[i]; i+=1);
         if(map_path) free(map_path);
         map_path = malloc(i + 1);
-        for(map_path[i + 1] = '\0'; i > -1; i-=1) map_path[i] = path[i];
+        for(; i > -1; i-=1) map_path[i] = path[i];
         return 0;
     }
 
@@ -456,7 +1281,7 @@ int save_map(const char* path){
     for(; path[i]; i+=1);
     if(map_path) free(map_path);
     map_path = malloc(i + 1);
-    for(map_path[i + 1] = '\0'; i > -1; i-=1) map_path[i] = path[i];
+    for(; i > -1; i-=1) map_path[i] = path[i];
     
     return 0;
 }
@@ -473,6 +1298,7 @@ int place(TILE tile, int x, int y){
             map[current_layer][i * mapw + j] = (TILE) tile;
         }
     }
+    mark_map_dirty(x, y, pencilw, pencilh);
     changed_since_last_save = 1;
     return 0;
 }
@@ -497,6 +1323,7 @@ int place_hollow(TILE tile, int x, int y){
     if(yrange > 0 && y + pencilh <= maph) for(int j = x0; j < xrange; j+=1){
         map[current_layer][(yrange - 1) * mapw + j]   = (TILE) tile;
     }
+    mark_map_dirty(x, y, pencilw, pencilh);
     changed_since_last_save = 1;
 
     return 0;
@@ -531,6 +1358,7 @@ int paste(int destx, int desty){
             map[current_layer][(i + desty) * mapw + (j + destx)] = map[current_layer][(i + copyy) * mapw + (j + copyx)];
         }
     }
+    mark_map_dirty(destx, desty, xrange, yrange);
     changed_since_last_save = 1;
 
     return 0;
@@ -566,6 +1394,45 @@ static inline int getascii_alpha_index(uint8_t alpha){
     return (alpha * (ascii_len - 1)) / 255; 
 }
 
+// brightness -> glyph for ascii_glyphs_map, rebuilt when the ascii map changes
+static char        ascii_glyphs[256];
+static const char* ascii_glyphs_map = NULL;
+static int         ascii_glyphs_len = 0;
+
+static inline void update_ascii_glyphs(void){
+    if(ascii_glyphs_map == ascii_map && ascii_glyphs_len == ascii_len) return ;
+    for(int i = 0; i < 256; i+=1) ascii_glyphs[i] = ascii_map[(i * (ascii_len - 1)) / 255];
+    ascii_glyphs_map = ascii_map;
+    ascii_glyphs_len = ascii_len;
+}
+
+// same as ascii_map[getascii_color_index(color)] for a whole row
+static inline void get_ascii_row(char* dst, const uint32_t* src, int n){
+    uint8_t luminance[256];
+    for(int i = 0; i < n; i+=256){
+        const int count = (n - i < 256)? n - i : 256;
+        luminance_row(luminance, &src[i], count);
+        for(int j = 0; j < count; j+=1) dst[i + j] = ascii_glyphs[luminance[j]];
+    }
+}
+
+// \returns 0 on success
+static int update_tileset_glyphs(void){
+    update_ascii_glyphs();
+    if(tileset_glyphs && tileset_glyphs_map == ascii_map && tileset_glyphs_len == ascii_len) return 0;
+    const size_t sprite_size = (size_t) tileset_tilew * tileset_tileh;
+    if(!tileset_glyphs){
+        tileset_glyphs = malloc((tileset_tile_count + 1) * sprite_size);
+        if(!tileset_glyphs) return 1;
+    }
+    for(int tile = 0; tile <= tileset_tile_count; tile+=1){
+        get_ascii_row(&tileset_glyphs[tile * sprite_size], tileset_sprite_lut[tile], (int) sprite_size);
+    }
+    tileset_glyphs_map = ascii_map;
+    tileset_glyphs_len = ascii_len;
+    return 0;
+}
+
 static int getascii_color_index(uint32_t color){
 
     const uint32_t rw = 2126;
@@ -584,319 +1451,2564 @@ static int getascii_color_index(uint32_t color){
     return (brightness <= 255)? (brightness * (ascii_len - 1)) / 255 : (ascii_len - 1);
 }
 
-static void print_map(int draw_interssections){
+// growable byte buffer, frames are assembled in one of these and written out at once
+typedef struct ByteBuffer {
+    char*  data;
+    size_t size;
+    size_t cap;
+} ByteBuffer;
+
+// \returns 0 on success
+static int reserve_bytes(ByteBuffer* buffer, size_t extra){
+    if(buffer->size + extra <= buffer->cap) return 0;
+    size_t cap = (buffer->cap)? buffer->cap : 4096;
+    while(cap < buffer->size + extra) cap *= 2;
+    char* const data = realloc(buffer->data, cap);
+    if(!data) return 1;
+    buffer->data = data;
+    buffer->cap = cap;
+    return 0;
+}
 
-    if(output == stdout) printf("\x1B[2J\x1B[H\n");
-    else{
-        if(output) fclose(output);
-        output = NULL;
-        output = fopen(output_path, "w");
-        if(!output){
-            fprintf(stderr, "[ERROR] could not open output '%s', switching back to stdout\n", output_path);
-            output = stdout;
-        }
-    }
+// callers reserve the space beforehand
+static inline void push_bytes(ByteBuffer* buffer, const char* bytes, size_t size){
+    memcpy(&buffer->data[buffer->size], bytes, size);
+    buffer->size += size;
+}
 
-    const int i0 = (cameray < 0)? 0 : cameray;
-    const int j0 = (camerax < 0)? 0 : camerax;
-    const int irange = (cameray + camerah < maph)? cameray + camerah : maph;
-    const int jrange = (camerax + cameraw < mapw)? camerax + cameraw : mapw;
+static inline void push_byte(ByteBuffer* buffer, char byte){
+    buffer->data[buffer->size++] = byte;
+}
 
-    int idigit_len = 1;
-    for(int _10n = 10; (int) (irange / _10n); _10n *= 10) idigit_len+=1;
+static void free_bytes(ByteBuffer* buffer){
+    free(buffer->data);
+    buffer->data = NULL;
+    buffer->size = 0;
+    buffer->cap = 0;
+}
 
-    int jdigit_len = 1;
-    for(int _10n = 10; (int) (jrange / _10n); _10n *= 10) jdigit_len+=1;
+// one write for the whole buffer, anything printed before it is flushed first to keep the order
+static int write_bytes(const ByteBuffer* buffer, FILE* f){
+    fflush(f);
+    const int err = fwrite(buffer->data, 1, buffer->size, f) != buffer->size;
+    fflush(f);
+    return err;
+}
 
-    for(int i = 0; i < idigit_len + 3; i+=1)
-        putc(' ', output);
-
-    for(int j = j0; j < jrange; j+=1)
-        fprintf(output, "%*i", jdigit_len + 1, j);
-    putc('\n', output);
-    for(int i = 0; i < idigit_len + 3; i+=1)
-        putc(' ', output);
-    for(int j = j0; j < jrange; j+=1){
-        for(int i = (jdigit_len / 2) + 1; i; i-=1)
-            putc(' ', output);
-        putc('|', output);
-    }
-    putc('\n', output);
-    for(int i = 0; i < idigit_len + 3; i+=1)
-        putc(' ', output);
-    for(int j = j0; j < jrange; j+=1)
-        for(int i = 0; i < (jdigit_len + 1); i+=1)
-            putc('_', output);
-
-    putc('\n', output);
-
-    if(draw_interssections){
-        for(int i = i0; i < irange; i+=1){
-            fprintf(output, "%*i- |", idigit_len, i);
-            for(int j = j0; j < jrange; j+=1){
-                for(int i = (jdigit_len / 2) + 1; i; i-=1)
-                    putc(' ', output);
-                int interssections = 0;
-                for(int k = 0; k < layers; k+=1){
-                    interssections += (map[k][i * mapw + j] != 0);
-                }
-                if(interssections > 9){
-                    putc('!', output);
-                }
-                else if(interssections > 0){
-                    putc('0' + interssections, output);
-                }
-                else{
-                    putc(' ', output);
-                }
-            }
-            putc('\n', output);
-        }
+// what the output file holds, so a new frame only rewrites the lines that changed
+static ByteBuffer file_frame;
+static uint64_t   file_frame_hash;
+
+// frames that weren't written to the output file because they came out the same as the one it already holds
+static int        skipped_frames = 0;
+
+// the text output stays open between displays, it's only opened again if something closed it
+// \returns 0 on success
+static int open_output_file(void){
+    if(output) return 0;
+    output = fopen(output_path, "w");
+    file_frame.size = 0;
+    if(!output){
+        fprintf(stderr, "[ERROR] could not open output '%s', switching back to stdout\n", output_path);
+        output = stdout;
+        return 1;
     }
-    else{
-        for(int i = i0; i < irange; i+=1){
-            fprintf(output, "%*i- |", idigit_len, i);
-            for(int j = j0; j < jrange; j+=1){
-                for(int i = (jdigit_len / 2) + 1; i; i-=1)
-                    putc(' ', output);
-
-                TILE actual_tile = map[current_layer][i * mapw + j];
-                for(int i = 0; i < sizeof(tile_mapping) / sizeof(tile_mapping[0]); i+=1){
-                    if(tile_mapping[i] == actual_tile){
-                        if(is_tile_mapped(i)){
-                            actual_tile = i;
-                            break;
-                        }
-                    }
-                }
+    return 0;
+}
 
-                putc(
-                    (actual_tile < palette_len && actual_tile >= 0)?
-                        (int) palette[actual_tile] : '~', output
-                );
+// writes the frame over the last one in place, only the runs of lines that differ are written
+// and the file is only truncated when the size of the frame changes
+// \returns 0 on success
+static int present_file_frame(const ByteBuffer* frame, FILE* f){
+    const uint64_t hash = hash_bytes(frame->data, frame->size);
+    if(frame->size == file_frame.size && hash == file_frame_hash){
+        skipped_frames += 1;
+        return 0;
+    }
+    fflush(f);
+    int err = 0;
+    if(frame->size != file_frame.size){
+        err |= write_file_at(f, frame->data, frame->size, 0);
+        err |= truncate_file(f, (long long) frame->size);
+    }
+    else{
+        size_t run = frame->size;
+        for(size_t start = 0; start < frame->size;){
+            const char* const newline = memchr(&frame->data[start], '\n', frame->size - start);
+            const size_t end = (newline)? (size_t) (newline - frame->data) + 1 : frame->size;
+            if(memcmp(&frame->data[start], &file_frame.data[start], end - start)){
+                if(run == frame->size) run = start;
             }
-            putc('\n', output);
+            else if(run != frame->size){
+                err |= write_file_at(f, &frame->data[run], start - run, (long long) run);
+                run = frame->size;
+            }
+            start = end;
         }
+        if(run != frame->size) err |= write_file_at(f, &frame->data[run], frame->size - run, (long long) run);
     }
 
+    file_frame.size = 0;
+    if(err || reserve_bytes(&file_frame, frame->size)){
+        fprintf(stderr, "[ERROR] could not write output '%s'\n", output_path);
+        // the next frame is written whole
+        file_frame.size = (size_t) -1;
+        return 1;
+    }
+    push_bytes(&file_frame, frame->data, frame->size);
+    file_frame_hash = hash;
+    return 0;
 }
 
+// a character cell of the terminal, glyph holds up to 4 utf-8 bytes with the first one in the lowest byte
+typedef struct TermCell {
+    uint32_t glyph;
+    uint32_t fg;
+    uint32_t bg;
+} TermCell;
+
+// the terminal's own color, real colors are stored as 0x00BBGGRR
+#define TERM_DEFAULT_COLOR 0xFFFFFFFF
+
+// U+2580 in utf-8
+#define UPPER_HALF_BLOCK 0x8096E2
+
+// the longest sequence push_term_cell can emit: two truecolor sgr sequences and a 4 byte glyph
+#define TERM_CELL_MAX_BYTES (2 * 19 + 4)
+
+static TermCell*  term_cells;
+static int        term_cellsw;
+static int        term_cellsh;
+static size_t     term_cells_cap;
+
+static ByteBuffer term_frame;
+static uint32_t   term_fg = TERM_DEFAULT_COLOR;
+static uint32_t   term_bg = TERM_DEFAULT_COLOR;
+
+// limits the terminal to the xterm 256 color palette, its escapes are a lot shorter than the 24 bit ones
+static int        term_256_colors = 0;
+
+// marks a color that is already an xterm 256 color palette index
+#define TERM_INDEXED_COLOR 0x01000000
+
+// 0x00BBGGRR with 5 bits per channel -> xterm 256 color palette index, built on first use
+static uint8_t    xterm256_lut[1 << 15];
+static int        xterm256_lut_ready = 0;
+
+// the last frame sent to a terminal, when it's still on screen only the cells that changed are redrawn
+static TermCell*  term_prev_cells;
+static int        term_prevw;
+static int        term_prevh;
+static size_t     term_prev_cap;
+static int        term_prev_valid = 0;
+// counts the frames present_term_cells sent to a terminal, anything printed in between can scroll the last one
+static unsigned int term_frames_presented = 0;
+
+// set by a renderer whose frame is the last one moved up by term_scroll_lines lines, or down if negative,
+// from line term_scroll_top on, so the terminal can scroll that part instead of getting it again
+static int        term_scroll_lines = 0;
+static int        term_scroll_top = 0;
+
+static ByteBuffer map_frame;
+
+static char    uint8_strings[256][4];
+static uint8_t uint8_string_lens[256];
+
+// \returns 0 on success
+static int resize_term_cells(int w, int h){
+    const size_t size = (size_t) w * h;
+    if(size > term_cells_cap){
+        TermCell* const cells = realloc(term_cells, size * sizeof(term_cells[0]));
+        if(!cells) return 1;
+        term_cells = cells;
+        term_cells_cap = size;
+    }
+    term_cellsw = w;
+    term_cellsh = h;
+    return 0;
+}
 
-static inline uint32_t blend_color_channel(const uint32_t ct, const uint32_t at, const uint32_t cb){
-    return (ct * at + (cb * (255 - at))) / 255;
+static inline void push_uint8(ByteBuffer* buffer, uint32_t value){
+    if(!uint8_string_lens[0]){
+        for(int i = 0; i < 256; i+=1){
+            uint8_string_lens[i] = (i > 99)? 3 : (i > 9)? 2 : 1;
+            int n = i;
+            for(int d = uint8_string_lens[i] - 1; d > -1; d-=1){
+                uint8_strings[i][d] = '0' + n % 10;
+                n /= 10;
+            }
+        }
+    }
+    push_bytes(buffer, uint8_strings[value], uint8_string_lens[value]);
 }
 
-static inline uint32_t blend_colors(const uint32_t ct, const uint32_t cb){
-    const uint32_t rb = (cb >>  0) & 0xFF;
-    const uint32_t gb = (cb >>  8) & 0xFF;
-    const uint32_t bb = (cb >> 16) & 0xFF;
-    const uint32_t ab = (cb >> 24) & 0xFF;
-    const uint32_t rt = (ct >>  0) & 0xFF;
-    const uint32_t gt = (ct >>  8) & 0xFF;
-    const uint32_t bt = (ct >> 16) & 0xFF;
-    const uint32_t at = (ct >> 24) & 0xFF;
-    const uint32_t ro = blend_color_channel(rt, at, rb);
-    const uint32_t go = blend_color_channel(gt, at, gb);
-    const uint32_t bo = blend_color_channel(bt, at, bb);
-    return (ro << 0) | (go << 8) | (bo << 16) | (ab << 24);
+static const uint8_t xterm256_levels[6] = {0, 95, 135, 175, 215, 255};
+
+static inline int nearest_xterm256_level(int c){
+    return (c < 48)? 0 : (c < 115)? 1 : (c - 35) / 40;
 }
 
-static inline const char* get_color_string(uint32_t foregroung_color, uint32_t background_color){
-    static char buff[64];
+static void build_xterm256_lut(void){
+    for(int i = 0; i < (1 << 15); i+=1){
+        // the middle of the 8 values each entry stands for
+        const int r = ((i >>  0) & 31) << 3 | 4;
+        const int g = ((i >>  5) & 31) << 3 | 4;
+        const int b = ((i >> 10) & 31) << 3 | 4;
+
+        // the nearest color of the 6x6x6 cube against the nearest of the 24 grays
+        const int ri = nearest_xterm256_level(r);
+        const int gi = nearest_xterm256_level(g);
+        const int bi = nearest_xterm256_level(b);
+        const int dr = r - xterm256_levels[ri];
+        const int dg = g - xterm256_levels[gi];
+        const int db = b - xterm256_levels[bi];
+        const int cube_distance = dr * dr + dg * dg + db * db;
+
+        const int average = (r + g + b) / 3;
+        const int gray = (average < 8)? 0 : (average > 238)? 23 : (average - 3) / 10;
+        const int gray_level = 8 + gray * 10;
+        const int gray_distance = (r - gray_level) * (r - gray_level) + (g - gray_level) * (g - gray_level) + (b - gray_level) * (b - gray_level);
+
+        xterm256_lut[i] = (gray_distance < cube_distance)? (uint8_t) (232 + gray) : (uint8_t) (16 + ri * 36 + gi * 6 + bi);
+    }
+    xterm256_lut_ready = 1;
+}
 
-    const uint8_t fr = (foregroung_color >>  0) & 0xFF;
-    const uint8_t fg = (foregroung_color >>  8) & 0xFF;
-    const uint8_t fb = (foregroung_color >> 16) & 0xFF;
-    const uint8_t fa = (foregroung_color >> 24) & 0xFF;
+static inline uint8_t get_xterm256_index(uint32_t color){
+    if(!xterm256_lut_ready) build_xterm256_lut();
+    return xterm256_lut[((color >> 3) & 31) | ((color >> 6) & (31 << 5)) | ((color >> 9) & (31 << 10))];
+}
 
+// \returns the color the way the terminal will get it, so cells that end up with the same palette index share the escape
+static inline uint32_t get_term_color(uint32_t color){
+    if(!term_256_colors || color == TERM_DEFAULT_COLOR) return color;
+    return TERM_INDEXED_COLOR | get_xterm256_index(color);
+}
 
-    const uint8_t br = (background_color >>  0) & 0xFF;
-    const uint8_t bg = (background_color >>  8) & 0xFF;
-    const uint8_t bb = (background_color >> 16) & 0xFF;
-    const uint8_t ba = (background_color >> 24) & 0xFF;
+// \param layer '3' for the foreground, '4' for the background
+static inline void push_sgr_color(ByteBuffer* buffer, char layer, uint32_t color){
+    push_byte(buffer, '\x1b');
+    push_byte(buffer, '[');
+    push_byte(buffer, layer);
+    if(color == TERM_DEFAULT_COLOR){
+        push_bytes(buffer, "9m", 2);
+        return;
+    }
+    if(color & TERM_INDEXED_COLOR){
+        push_bytes(buffer, "8;5;", 4);
+        push_uint8(buffer, color & 0xFF);
+        push_byte(buffer, 'm');
+        return;
+    }
+    push_bytes(buffer, "8;2;", 4);
+    push_uint8(buffer, (color >>  0) & 0xFF);
+    push_byte(buffer, ';');
+    push_uint8(buffer, (color >>  8) & 0xFF);
+    push_byte(buffer, ';');
+    push_uint8(buffer, (color >> 16) & 0xFF);
+    push_byte(buffer, 'm');
+}
 
-    sprintf(
-        buff,
-        "\x1b[38;2;%" PRIu8 ";%" PRIu8 ";%" PRIu8 "m"
-        "\x1b[48;2;%" PRIu8 ";%" PRIu8 ";%" PRIu8 "m",
-        fr, fg, fb,
-        br, bg, bb
-    );
+// only emits the colors that changed since the last cell, a space only needs its background
+static inline void push_term_cell(ByteBuffer* buffer, const TermCell* cell){
+    const uint32_t fg = get_term_color(cell->fg);
+    const uint32_t bg = get_term_color(cell->bg);
+    if(cell->glyph != ' ' && fg != term_fg){
+        push_sgr_color(buffer, '3', fg);
+        term_fg = fg;
+    }
+    if(bg != term_bg){
+        push_sgr_color(buffer, '4', bg);
+        term_bg = bg;
+    }
+    uint32_t glyph = cell->glyph;
+    do {
+        push_byte(buffer, (char) (glyph & 0xFF));
+        glyph >>= 8;
+    } while(glyph);
+}
 
-    return buff;
+static inline void push_term_reset(ByteBuffer* buffer){
+    if(term_fg != TERM_DEFAULT_COLOR || term_bg != TERM_DEFAULT_COLOR) push_bytes(buffer, "\x1b[0m", 4);
+    term_fg = TERM_DEFAULT_COLOR;
+    term_bg = TERM_DEFAULT_COLOR;
 }
 
-static void put_color_char(uint32_t color){
+// the next frame will repaint the whole screen, for when something else was printed over the last one
+static inline void invalidate_term_frame(void){
+    term_prev_valid = 0;
+}
 
-    const uint8_t a = (color >> 24) & 0xFF;
+static inline void push_cursor_position(ByteBuffer* buffer, int row, int column){
+    push_bytes(buffer, "\x1b[", 2);
+    char digits[12];
+    int len = 0;
+    for(int n = row + 1; n; n /= 10) digits[len++] = '0' + n % 10;
+    while(len) push_byte(buffer, digits[--len]);
+    push_byte(buffer, ';');
+    for(int n = column + 1; n; n /= 10) digits[len++] = '0' + n % 10;
+    while(len) push_byte(buffer, digits[--len]);
+    push_byte(buffer, 'H');
+}
 
-    const char c = ascii_map[getascii_alpha_index(a)];
+static inline void push_uint(ByteBuffer* buffer, uint32_t value){
+    char digits[10];
+    int len = 0;
+    do{
+        digits[len++] = '0' + value % 10;
+        value /= 10;
+    } while(value);
+    while(len) push_byte(buffer, digits[--len]);
+}
 
-    printf("%s%c\x1b[0m", get_color_string(color, (a == 255)? color : 0x0), (a == 255)? ' ' : c);
+static inline int is_blank_cell(const TermCell* cell){
+    return cell->glyph == ' ' && cell->bg == TERM_DEFAULT_COLOR;
 }
 
-static void render_tile_graphical(int tile, int x, int y, uint32_t* pixels, int pixelsw, int pixelsh, int pixels_stride){
-    if(!pixels || !tileset) return;
-    
-    const int y0 = (y < 0)? 0 : y;
-    const int x0 = (x < 0)? 0 : x;
-    const int yrange = (y + tileset_tileh < pixelsh)? y + tileset_tileh : pixelsh;
-    const int xrange = (x + tileset_tilew < pixelsw)? x + tileset_tilew : pixelsw;
+// scrolls the part of the terminal a renderer said moved, if that leaves fewer rows to send,
+// and term_prev_cells with it so the diff only sends the rows that scrolled in
+static void push_term_scroll(int w, int h, int lines, int top){
+    if(!lines || top < 0 || abs(lines) >= h - top) return ;
+
+    const size_t row_size = (size_t) w * sizeof(TermCell);
+    int kept = 0;
+    int moved = 0;
+    for(int i = top; i < h; i+=1){
+        const TermCell* const row = &term_cells[(size_t) i * w];
+        kept += !memcmp(row, &term_prev_cells[(size_t) i * w], row_size);
+        if(i + lines >= top && i + lines < h) moved += !memcmp(row, &term_prev_cells[(size_t) (i + lines) * w], row_size);
+    }
+    if(moved <= kept) return ;
+
+    // the rows that scroll in take the current background
+    push_term_reset(&term_frame);
+    // the frame starts on the second line of the screen
+    push_bytes(&term_frame, "\x1b[", 2);
+    push_uint(&term_frame, (uint32_t) top + 2);
+    push_byte(&term_frame, ';');
+    push_uint(&term_frame, (uint32_t) h + 1);
+    push_bytes(&term_frame, "r\x1b[", 3);
+    push_uint(&term_frame, (uint32_t) abs(lines));
+    push_byte(&term_frame, (lines > 0)? 'S' : 'T');
+    push_bytes(&term_frame, "\x1b[r", 3);
+
+    const TermCell blank = {' ', TERM_DEFAULT_COLOR, TERM_DEFAULT_COLOR};
+    TermCell* const region = &term_prev_cells[(size_t) top * w];
+    const int region_rows = h - top;
+    if(lines > 0){
+        memmove(region, &region[(size_t) lines * w], (size_t) (region_rows - lines) * row_size);
+        for(size_t i = (size_t) (region_rows - lines) * w; i < (size_t) region_rows * w; i+=1) region[i] = blank;
+    }
+    else{
+        memmove(&region[(size_t) -lines * w], region, (size_t) (region_rows + lines) * row_size);
+        for(size_t i = 0; i < (size_t) -lines * w; i+=1) region[i] = blank;
+    }
+}
 
-    tile -= 1;
+// encodes the cell grid and writes it to stdout at once,
+// on a terminal that still shows the last frame only the changed cells are sent, inside a synchronized update
+static void present_term_cells(void){
+    const int w = term_cellsw;
+    const int h = term_cellsh;
+    const int terminal = is_terminal(stdout);
+    // the hint is only good for the frame it was given with
+    const int scroll_lines = term_scroll_lines;
+    term_scroll_lines = 0;
+
+    term_frame.size = 0;
+    // the worst case is every cell on its own: a cursor move and the cell
+    if(reserve_bytes(&term_frame, 96 + (size_t) h * (w * (TERM_CELL_MAX_BYTES + 16) + 24))){
+        fprintf(stderr, "[ERROR] could not allocate terminal frame\n");
+        return ;
+    }
 
-    if(tile >= tilesetx * tilesety || tile < 0){
-        const uint32_t color = 0xFF0000FF;
-        for(int i = y0; i < yrange; i+=1){
-            for(int j = x0; j < xrange; j+=1){
-                pixels[i * pixels_stride + j] = color;
-            }
+    if(!terminal){
+        push_bytes(&term_frame, "\x1B[2J\x1B[H\n", 8);
+        for(int i = 0; i < h; i+=1){
+            const TermCell* const row = &term_cells[(size_t) i * w];
+            for(int j = 0; j < w; j+=1) push_term_cell(&term_frame, &row[j]);
+            push_term_reset(&term_frame);
+            push_byte(&term_frame, '\n');
         }
-        return;
+        write_bytes(&term_frame, stdout);
+        return ;
     }
-    const int tiley = (tile / (tilesetx / tileset_tilew));
-    const int tilex = (tile % (tilesetx / tileset_tilew));
-    const int tileoffset = tiley * tileset_tileh * tilesetx + tilex * tileset_tilew;
 
-    y = y0;
-    for(int i = 0; i < tileset_tileh && y < yrange; i+=1){
-        x = x0;
-        for(int j = 0; j < tileset_tilew && x < xrange; j+=1){
-            uint32_t color = 0;
-            for(int k = 0; k < tileset_comp; k+=1){
-                color |= (tileset[(tileoffset + i * tilesetx + j) * tileset_comp + k]) << (k * 8);
+    // absolute cursor moves are only right while the frame, the empty line above it and the prompt fit on screen
+    int columns = 0;
+    int rows = 0;
+    const int fits = get_terminal_size(stdout, &columns, &rows) == 0 && h + 2 < rows && w <= columns;
+
+    push_bytes(&term_frame, "\x1b[?2026h", 8);
+
+    if(fits && term_prev_valid && term_prevw == w && term_prevh == h){
+        push_term_scroll(w, h, scroll_lines, term_scroll_top);
+        int cursor_row = -1;
+        int cursor_column = -1;
+        for(int i = 0; i < h; i+=1){
+            const TermCell* const row  = &term_cells[(size_t) i * w];
+            const TermCell* const prev = &term_prev_cells[(size_t) i * w];
+            for(int j = 0; j < w; j+=1){
+                if(row[j].glyph == prev[j].glyph && row[j].fg == prev[j].fg && row[j].bg == prev[j].bg) continue;
+                // the frame starts below the empty line
+                if(cursor_row != i + 1 || cursor_column != j) push_cursor_position(&term_frame, i + 1, j);
+                push_term_cell(&term_frame, &row[j]);
+                cursor_row = i + 1;
+                cursor_column = j + 1;
             }
-            pixels[y * pixels_stride + x] = blend_colors(color, pixels[y * pixels_stride + x]);
-            x += 1;
         }
-        y += 1;
+        push_term_reset(&term_frame);
+        // erases whatever was printed under the last frame, like the prompt
+        push_cursor_position(&term_frame, h + 1, 0);
+        push_bytes(&term_frame, "\x1b[J", 3);
     }
+    else{
+        push_bytes(&term_frame, "\x1B[2J\x1B[H\n", 8);
+        for(int i = 0; i < h; i+=1){
+            const TermCell* const row = &term_cells[(size_t) i * w];
+            int len = w;
+            for(; len > 0 && is_blank_cell(&row[len - 1]); len-=1);
+            for(int j = 0; j < len; j+=1) push_term_cell(&term_frame, &row[j]);
+            push_term_reset(&term_frame);
+            push_byte(&term_frame, '\n');
+        }
+    }
+
+    push_bytes(&term_frame, "\x1b[?2026l", 8);
+    write_bytes(&term_frame, stdout);
+
+    // the cells are kept as the last frame, swapping the buffers
+    TermCell* const cells = term_prev_cells;
+    const size_t cap = term_prev_cap;
+    term_prev_cells = term_cells;
+    term_prev_cap = term_cells_cap;
+    term_cells = cells;
+    term_cells_cap = cap;
+    term_prevw = w;
+    term_prevh = h;
+    term_prev_valid = fits;
+    term_frames_presented += 1;
 }
 
-static void render_graphical(int draw_all_layers){
+// a plain text frame, written as is when stdout isn't a terminal
+static void present_term_text(const char* text, size_t size){
+    if(!is_terminal(stdout)){
+        term_frame.size = 0;
+        if(reserve_bytes(&term_frame, size + 8)){
+            fprintf(stderr, "[ERROR] could not allocate terminal frame\n");
+            return ;
+        }
+        push_bytes(&term_frame, "\x1B[2J\x1B[H\n", 8);
+        push_bytes(&term_frame, text, size);
+        write_bytes(&term_frame, stdout);
+        return ;
+    }
+
+    int w = 0;
+    int h = 0;
+    for(size_t i = 0, len = 0; i < size; i+=1){
+        if(text[i] == '\n'){
+            h += 1;
+            len = 0;
+            continue;
+        }
+        len += 1;
+        if((int) len > w) w = (int) len;
+    }
+    if(size && text[size - 1] != '\n') h += 1;
+
+    if(resize_term_cells(w, h)){
+        fprintf(stderr, "[ERROR] could not allocate terminal frame\n");
+        return ;
+    }
+    const TermCell blank = {' ', TERM_DEFAULT_COLOR, TERM_DEFAULT_COLOR};
+    for(size_t i = 0; i < (size_t) w * h; i+=1) term_cells[i] = blank;
+    int row = 0;
+    int column = 0;
+    for(size_t i = 0; i < size; i+=1){
+        if(text[i] == '\n'){
+            row += 1;
+            column = 0;
+            continue;
+        }
+        term_cells[(size_t) row * w + column++].glyph = (uint8_t) text[i];
+    }
+    present_term_cells();
+}
+
+// one cell per pixel, the same way put_color_char draws them
+static void present_term_pixels(int w, int h){
+    if(resize_term_cells(w, h)){
+        fprintf(stderr, "[ERROR] could not allocate terminal frame\n");
+        return ;
+    }
+    for(int i = 0; i < h; i+=1){
+        const uint32_t* const src = &pixels[(size_t) i * pixelsw];
+        TermCell* const dst = &term_cells[(size_t) i * w];
+        for(int j = 0; j < w; j+=1){
+            const uint32_t color = src[j];
+            const uint8_t  a = (color >> 24) & 0xFF;
+            dst[j].glyph = (a == 255)? ' ' : (uint8_t) ascii_map[getascii_alpha_index(a)];
+            dst[j].fg    = color & 0xFFFFFF;
+            dst[j].bg    = (a == 255)? color & 0xFFFFFF : 0;
+        }
+    }
+    present_term_cells();
+}
+
+// writes value right aligned in width characters, the ones it doesn't use become spaces
+static inline void put_padded_uint(char* dst, int width, unsigned int value){
+    int i = width - 1;
+    do {
+        dst[i--] = '0' + value % 10;
+        value /= 10;
+    } while(value && i > -1);
+    for(; i > -1; i-=1) dst[i] = ' ';
+}
+
+// the map as print_map shows it into frame
+// \returns 0 on success
+static int build_map_text(const FrameView* view, int draw_interssections, ByteBuffer* frame){
+
+    const int i0 = (view->cameray < 0)? 0 : view->cameray;
+    const int j0 = (view->camerax < 0)? 0 : view->camerax;
+    const int irange = (view->cameray + view->camerah < view->maph)? view->cameray + view->camerah : view->maph;
+    const int jrange = (view->camerax + view->cameraw < view->mapw)? view->camerax + view->cameraw : view->mapw;
+
+    int idigit_len = 1;
+    for(int _10n = 10; (int) (irange / _10n); _10n *= 10) idigit_len+=1;
+
+    int jdigit_len = 1;
+    for(int _10n = 10; (int) (jrange / _10n); _10n *= 10) jdigit_len+=1;
+
+    const int rows    = (irange > i0)? irange - i0 : 0;
+    const int columns = (jrange > j0)? jrange - j0 : 0;
+
+    // every line has the same layout: the row number margin, then a fixed width column per tile
+    const size_t margin       = (size_t) idigit_len + 3;
+    const size_t header_width = (size_t) jdigit_len + 1;
+    const size_t cell_width   = (size_t) (jdigit_len / 2) + 2;
+    const size_t header_line  = margin + columns * header_width + 1;
+    const size_t row_line     = margin + columns * cell_width + 1;
+
+    frame->size = 0;
+    if(reserve_bytes(frame, 2 * header_line + (rows + 1) * row_line)) return 1;
+    frame->size = 2 * header_line + (rows + 1) * row_line;
+
+    char* line = frame->data;
+    memset(line, ' ', margin);
+    for(int j = 0; j < columns; j+=1) put_padded_uint(&line[margin + j * header_width], (int) header_width, (unsigned int) (j0 + j));
+    line[header_line - 1] = '\n';
+
+    line += header_line;
+    memset(line, ' ', row_line - 1);
+    for(int j = 0; j < columns; j+=1) line[margin + j * cell_width + cell_width - 1] = '|';
+    line[row_line - 1] = '\n';
+
+    line += row_line;
+    memset(line, ' ', margin);
+    memset(&line[margin], '_', columns * header_width);
+    line[header_line - 1] = '\n';
+
+    line += header_line;
+    for(int i = i0; i < irange; i+=1, line += row_line){
+        memset(line, ' ', row_line - 1);
+        put_padded_uint(line, idigit_len, (unsigned int) i);
+        line[idigit_len] = '-';
+        line[idigit_len + 2] = '|';
+        line[row_line - 1] = '\n';
+        char* const symbols = &line[margin + cell_width - 1];
+        if(draw_interssections && view->composite){
+            const CompositeCell* const cells = &view->composite[(size_t) (i - view->y0) * view->stride + (j0 - view->x0)];
+            for(int j = 0; j < columns; j+=1){
+                const int interssections = cells[j].count;
+                symbols[j * cell_width] = (interssections > 9)? '!' : (interssections > 0)? '0' + interssections : ' ';
+            }
+        }
+        else if(draw_interssections){
+            for(int j = 0; j < columns; j+=1){
+                int interssections = 0;
+                for(int k = 0; k < view->layers; k+=1){
+                    if(view->styles && !view->styles[k].visible) continue;
+                    interssections += (get_view_tile(view, k, i, j0 + j) != 0);
+                }
+                symbols[j * cell_width] = (interssections > 9)? '!' : (interssections > 0)? '0' + interssections : ' ';
+            }
+        }
+        else{
+            for(int j = 0; j < columns; j+=1) symbols[j * cell_width] = get_tile_symbol(view, get_view_tile(view, view->current_layer, i, j0 + j));
+        }
+    }
+    return 0;
+}
+
+// the first map row and column of the last terminal map frame
+static int term_map_i0 = 0;
+static int term_map_j0 = 0;
+
+// puts map_frame, built from view, on the terminal
+static void present_map_frame(const FrameView* view){
+    const int i0 = (view->cameray < 0)? 0 : view->cameray;
+    const int j0 = (view->camerax < 0)? 0 : view->camerax;
+    // a camera that only moved up or down moves the rows under the three header lines
+    if(j0 == term_map_j0){
+        term_scroll_lines = i0 - term_map_i0;
+        term_scroll_top = 3;
+    }
+    term_map_i0 = i0;
+    term_map_j0 = j0;
+    present_term_text(map_frame.data, map_frame.size);
+}
+
+// print_map on the terminal, whatever the output is
+static void print_map_terminal(int draw_interssections){
+    const FrameView view = get_live_view(draw_interssections);
+    if(build_map_text(&view, draw_interssections, &map_frame)){
+        fprintf(stderr, "[ERROR] could not allocate map frame\n");
+        return ;
+    }
+    present_map_frame(&view);
+}
+
+// the text output's frame, only touched by whoever draws the file frames
+static ByteBuffer file_map_frame;
+
+static void print_map_file(const FrameView* view, int draw_interssections){
+    if(build_map_text(view, draw_interssections, &file_map_frame)){
+        fprintf(stderr, "[ERROR] could not allocate map frame\n");
+        return ;
+    }
+    present_file_frame(&file_map_frame, output);
+}
+
+enum FileFrameKind {
+    FILE_FRAME_MAP = 0,
+    FILE_FRAME_GRAPHICAL,
+    // a map frame that was already built for the terminal, the snapshot only holds its text
+    FILE_FRAME_TEXT
+};
+
+static void request_file_frame(int kind, int draw_flag);
+
+static void print_map(int draw_interssections){
+    if(output == stdout) print_map_terminal(draw_interssections);
+    else                 request_file_frame(FILE_FRAME_MAP, draw_interssections);
+}
+
+
+// \returns the straight alpha color of a premultiplied one
+static inline uint32_t unpremultiply_color(const uint32_t color){
+    const uint32_t a = (color >> 24) & 0xFF;
+    if(a == 255 || a == 0) return color;
+    const uint32_t r = (((color >>  0) & 0xFF) * 255 + a / 2) / a;
+    const uint32_t g = (((color >>  8) & 0xFF) * 255 + a / 2) / a;
+    const uint32_t b = (((color >> 16) & 0xFF) * 255 + a / 2) / a;
+    return ((r > 255)? 255 : r) | (((g > 255)? 255 : g) << 8) | (((b > 255)? 255 : b) << 16) | (a << 24);
+}
+
+static inline const char* get_color_string(uint32_t foregroung_color, uint32_t background_color){
+    static char buff[64];
+
+    const uint8_t fr = (foregroung_color >>  0) & 0xFF;
+    const uint8_t fg = (foregroung_color >>  8) & 0xFF;
+    const uint8_t fb = (foregroung_color >> 16) & 0xFF;
+    const uint8_t fa = (foregroung_color >> 24) & 0xFF;
+
+
+    const uint8_t br = (background_color >>  0) & 0xFF;
+    const uint8_t bg = (background_color >>  8) & 0xFF;
+    const uint8_t bb = (background_color >> 16) & 0xFF;
+    const uint8_t ba = (background_color >> 24) & 0xFF;
+
+    if(term_256_colors){
+        sprintf(
+            buff,
+            "\x1b[38;5;%" PRIu8 "m"
+            "\x1b[48;5;%" PRIu8 "m",
+            get_xterm256_index(foregroung_color),
+            get_xterm256_index(background_color)
+        );
+        return buff;
+    }
+
+    sprintf(
+        buff,
+        "\x1b[38;2;%" PRIu8 ";%" PRIu8 ";%" PRIu8 "m"
+        "\x1b[48;2;%" PRIu8 ";%" PRIu8 ";%" PRIu8 "m",
+        fr, fg, fb,
+        br, bg, bb
+    );
+
+    return buff;
+}
+
+static void put_color_char(uint32_t color){
+
+    const uint8_t a = (color >> 24) & 0xFF;
+
+    const char c = ascii_map[getascii_alpha_index(a)];
+
+    printf("%s%c\x1b[0m", get_color_string(color, (a == 255)? color : 0x0), (a == 255)? ' ' : c);
+}
+
+// \returns 0 on success
+static int resize_framebuffer(int w, int h){
+    const size_t size = (size_t) w * h;
+    if(size > pixels_cap){
+        uint32_t* const npixels = realloc(pixels, size * sizeof(pixels[0]));
+        if(!npixels) return 1;
+        pixels = npixels;
+        pixels_cap = size;
+    }
+    pixelsw = w;
+    pixelsh = h;
+    return 0;
+}
+
+static void free_framebuffer(void){
+    free(pixels);
+    free(drawn_cells);
+    free(next_cells);
+    pixels = NULL;
+    drawn_cells = NULL;
+    next_cells = NULL;
+    drawn_cells_cap = 0;
+    drawn_valid = 0;
+    pixels_cap = 0;
+    pixelsw = 0;
+    pixelsh = 0;
+}
+
+static void render_tile_graphical(const SpriteMip* mip, TILE tile, uint32_t factors, int x, int y, uint32_t* pixels, int pixelsw, int pixelsh, int pixels_stride){
+    if(!pixels || !tileset_sprites) return;
+
+    const int tilew = mip->tilew;
+    const int y0 = (y < 0)? 0 : y;
+    const int x0 = (x < 0)? 0 : x;
+    const int yrange = (y + mip->tileh < pixelsh)? y + mip->tileh : pixelsh;
+    const int xrange = (x + tilew < pixelsw)? x + tilew : pixelsw;
+    if(x0 >= xrange) return;
+
+    const int opacity = get_tile_opacity(tile);
+    if(opacity == TILE_TRANSPARENT) return;
+
+    const uint32_t* const sprite = get_tile_sprite(mip, tile);
+
+    if(factors != LAYER_STYLE_PLAIN){
+        for(int i = y0; i < yrange; i+=1){
+            blend_scaled_row(&pixels[i * pixels_stride + x0], &sprite[(i - y) * tilew + (x0 - x)], xrange - x0, factors);
+        }
+        return;
+    }
+    if(opacity == TILE_OPAQUE){
+        for(int i = y0; i < yrange; i+=1){
+            memcpy(&pixels[i * pixels_stride + x0], &sprite[(i - y) * tilew + (x0 - x)], (xrange - x0) * sizeof(pixels[0]));
+        }
+        return;
+    }
+    for(int i = y0; i < yrange; i+=1){
+        blend_row(&pixels[i * pixels_stride + x0], &sprite[(i - y) * tilew + (x0 - x)], xrange - x0);
+    }
+}
+
+// the graphical renderer splits the framebuffer into bands of tile rows drawn by a worker pool,
+// every band owns its rows so the frame comes out the same with any number of threads
+static WorkerPool render_pool;
+static int        render_pool_started = 0;
+// 0 picks one per cpu
+static int        render_threads = 0;
+
+// frames smaller than this are drawn on the calling thread, waking the workers would cost more than it saves
+#define PARALLEL_RENDER_MIN_PIXELS (256 * 256)
+
+// pixel rows the content of the last frame moved up by, or down if negative, so the terminal can scroll along
+static int framebuffer_scroll = 0;
+
+typedef struct GraphicalFrame {
+    const FrameView* view;
+    const SpriteMip* mip;
+    int              draw_all_layers;
+    int              depth;
+    int              rows;
+    int              columns;
+    // whether the cells of the last frame are in the framebuffer, moved by di, dj cells
+    int              reuse;
+    int              di;
+    int              dj;
+} GraphicalFrame;
+
+// moves the content of the framebuffer dx pixels right and dy pixels down, what it uncovers keeps the old pixels
+static void shift_framebuffer(int dx, int dy){
+    const int w = pixelsw - abs(dx);
+    if(w <= 0 || abs(dy) >= pixelsh) return ;
+    if(!dx){
+        const size_t moved = (size_t) pixelsw * (pixelsh - abs(dy));
+        if(dy > 0) memmove(&pixels[(size_t) dy * pixelsw], pixels, moved * sizeof(pixels[0]));
+        else       memmove(pixels, &pixels[(size_t) -dy * pixelsw], moved * sizeof(pixels[0]));
+        return ;
+    }
+    const int srcx = (dx < 0)? -dx : 0;
+    const int dstx = (dx > 0)? dx : 0;
+    if(dy > 0){
+        for(int y = pixelsh - 1; y >= dy; y-=1)
+            memmove(&pixels[(size_t) y * pixelsw + dstx], &pixels[(size_t) (y - dy) * pixelsw + srcx], w * sizeof(pixels[0]));
+    }
+    else{
+        for(int y = 0; y < pixelsh + dy; y+=1)
+            memmove(&pixels[(size_t) y * pixelsw + dstx], &pixels[(size_t) (y - dy) * pixelsw + srcx], w * sizeof(pixels[0]));
+    }
+}
+
+// paints the cell at x, y of the w wide buffer dst black, cells are as big as the sprites of mip
+static void clear_cell(const SpriteMip* mip, int x, int y, uint32_t* dst, int w){
+    uint32_t* const cell = &dst[(size_t) y * w + x];
+    for(int j = 0; j < mip->tilew; j+=1) cell[j] = 0xFF000000;
+    for(int i = 1; i < mip->tileh; i+=1) memcpy(&cell[(size_t) i * w], cell, mip->tilew * sizeof(cell[0]));
+}
+
+// draws the depth tiles of a cell at x, y of the w by h buffer dst with the sprites of mip, the first one on top,
+// styles has the style of every tile's layer or is NULL to draw them as they are
+static void draw_graphical_cell(const SpriteMip* mip, const TILE* tiles, int depth, const LayerStyle* styles, int x, int y, uint32_t* dst, int w, int h){
+    // nothing under the topmost opaque tile can be seen, and it covers the whole cell
+    int bottom = 0;
+    for(; bottom < depth - 1; bottom+=1){
+        if(get_layer_tile_opacity(styles, bottom, tiles[bottom]) == TILE_OPAQUE) break;
+    }
+    if(!depth || get_layer_tile_opacity(styles, bottom, tiles[bottom]) != TILE_OPAQUE) clear_cell(mip, x, y, dst, w);
+    for(int k = bottom; k > -1 && depth; k-=1){
+        if(styles && !styles[k].visible) continue;
+        render_tile_graphical(mip, tiles[k], (styles)? styles[k].factors : LAYER_STYLE_PLAIN, x, y, dst, w, h, w);
+    }
+}
+
+// draws the camera's cell rows row0 up to row1 that aren't already in the framebuffer
+static void draw_graphical_rows(const GraphicalFrame* frame, int row0, int row1){
+    const FrameView* const view = frame->view;
+    const int depth = frame->depth;
+    const LayerStyle* const styles = (frame->draw_all_layers)? view->styles : NULL;
+    const int i0 = (view->cameray < 0)? 0 : view->cameray;
+    const int j0 = (view->camerax < 0)? 0 : view->camerax;
+
+    for(int r = row0; r < row1; r+=1){
+        for(int c = 0; c < view->cameraw; c+=1){
+            const int in_map = r < frame->rows && c < frame->columns;
+            TILE* const tiles = &next_cells[((size_t) r * view->cameraw + c) * depth];
+            if(in_map){
+                if(frame->draw_all_layers && view->composite){
+                    // the layers under the topmost opaque tile are left as 0, which doesn't change how the cell looks
+                    const int visible = view->composite[(size_t) (i0 + r - view->y0) * view->stride + (j0 + c - view->x0)].depth;
+                    for(int k = 0; k < visible; k+=1) tiles[k] = (styles && !styles[k].visible)? 0 : get_view_tile(view, k, i0 + r, j0 + c);
+                    for(int k = visible; k < depth; k+=1) tiles[k] = 0;
+                }
+                else if(frame->draw_all_layers){
+                    for(int k = 0; k < depth; k+=1) tiles[k] = (styles && !styles[k].visible)? 0 : get_view_tile(view, k, i0 + r, j0 + c);
+                }
+                else if(depth) tiles[0] = get_view_tile(view, view->current_layer, i0 + r, j0 + c);
+            }
+
+            if(frame->reuse){
+                const int pr = r + frame->di;
+                const int pc = c + frame->dj;
+                if(pr >= 0 && pr < view->camerah && pc >= 0 && pc < view->cameraw){
+                    const int was_in_map = pr < drawn_rows && pc < drawn_columns;
+                    const TILE* const drawn = &drawn_cells[((size_t) pr * view->cameraw + pc) * depth];
+                    if(was_in_map == in_map && (!in_map || !memcmp(tiles, drawn, depth * sizeof(tiles[0])))) continue;
+                }
+            }
+
+            if(in_map) draw_graphical_cell(frame->mip, tiles, depth, styles, c * frame->mip->tilew, r * frame->mip->tileh, pixels, pixelsw, pixelsh);
+            else       clear_cell(frame->mip, c * frame->mip->tilew, r * frame->mip->tileh, pixels, pixelsw);
+        }
+    }
+}
+
+static void draw_graphical_band(void* arg, int band, int band_count){
+    const GraphicalFrame* const frame = (const GraphicalFrame*) arg;
+    const int rows = frame->view->camerah;
+    draw_graphical_rows(frame, rows * band / band_count, rows * (band + 1) / band_count);
+}
+
+// the map seen from far away, level 0 has a pixel per cell with the average colors of its tiles composited
+// and every level after it halves the one before until a single pixel is left,
+// the cells marked dirty are composited again and averaged up before a frame is drawn from it
+#define OVERVIEW_MAX_LEVELS 32
+
+typedef struct OverviewLevel {
+    uint32_t* pixels;
+    int       w;
+    int       h;
+} OverviewLevel;
+
+static OverviewLevel   overview_levels[OVERVIEW_MAX_LEVELS];
+static int             overview_level_count = 0;
+static int             overview_valid = 0;
+// -1 when it shows all layers, the layer it shows otherwise
+static int             overview_source;
+static const uint32_t* overview_sprites;
+static unsigned int    overview_styles_version;
+
+static void free_overview(void){
+    for(int level = 0; level < overview_level_count; level+=1) free(overview_levels[level].pixels);
+    overview_level_count = 0;
+    overview_valid = 0;
+}
+
+// \returns 0 on success
+static int resize_overview(void){
+    if(overview_level_count && overview_levels[0].w == mapw && overview_levels[0].h == maph) return 0;
+    free_overview();
+    int w = mapw;
+    int h = maph;
+    for(;;){
+        overview_levels[overview_level_count].pixels = malloc((size_t) w * h * sizeof(uint32_t));
+        overview_levels[overview_level_count].w = w;
+        overview_levels[overview_level_count].h = h;
+        overview_level_count += 1;
+        if(!overview_levels[overview_level_count - 1].pixels){
+            free_overview();
+            return 1;
+        }
+        if(w == 1 && h == 1) break;
+        w = (w + 1) / 2;
+        h = (h + 1) / 2;
+    }
+    return 0;
+}
+
+// composites the cells x0 up to x1 and y0 up to y1 of level 0
+static void compose_overview_cells(int source, int x0, int y0, int x1, int y1){
+    uint32_t* const dst = overview_levels[0].pixels;
+    const LayerStyle* const styles = get_layer_styles();
+    for(int i = y0; i < y1; i+=1){
+        for(int j = x0; j < x1; j+=1){
+            const size_t cell = (size_t) i * mapw + j;
+            uint32_t color = 0xFF000000;
+            if(source < 0){
+                for(int k = layers - 1; k > -1; k-=1){
+                    if(styles && !styles[k].visible) continue;
+                    const uint32_t average = get_tile_average_color(map[k][cell]);
+                    color = blend_colors((styles)? scale_color(average, styles[k].factors) : average, color);
+                }
+            }
+            else if(source < layers) color = blend_colors(get_tile_average_color(map[source][cell]), color);
+            dst[cell] = color;
+        }
+    }
+}
+
+// averages the pixels x0 up to x1 and y0 up to y1 of level from the level under it
+static void reduce_overview_level(int level, int x0, int y0, int x1, int y1){
+    const OverviewLevel* const src = &overview_levels[level - 1];
+    const OverviewLevel* const dst = &overview_levels[level];
+    for(int i = y0; i < y1; i+=1){
+        for(int j = x0; j < x1; j+=1) dst->pixels[(size_t) i * dst->w + j] = average_2x2(src->pixels, src->w, src->h, i, j);
+    }
+}
 
-    if(!tileset){
+// brings the overview up to date with the map, the tileset has to be ready
+// \returns 0 on success
+static int update_overview(int draw_all_layers){
+    const int source = (draw_all_layers)? -1 : current_layer;
+    if(!overview_valid || overview_levels[0].w != mapw || overview_levels[0].h != maph || overview_source != source || overview_sprites != tileset_sprites
+        || overview_styles_version != layer_styles_version){
+        if(resize_overview()) return 1;
+        add_dirty_rect(&overview_dirty, 0, 0, mapw, maph);
+    }
+    int x0 = overview_dirty.x0;
+    int y0 = overview_dirty.y0;
+    int x1 = overview_dirty.x1;
+    int y1 = overview_dirty.y1;
+    if(x0 < x1 && y0 < y1){
+        compose_overview_cells(source, x0, y0, x1, y1);
+        for(int level = 1; level < overview_level_count; level+=1){
+            x0 /= 2;
+            y0 /= 2;
+            x1 = (x1 + 1) / 2;
+            y1 = (y1 + 1) / 2;
+            reduce_overview_level(level, x0, y0, x1, y1);
+        }
+    }
+    overview_dirty.x0 = overview_dirty.x1 = 0;
+    overview_dirty.y0 = overview_dirty.y1 = 0;
+    overview_valid = 1;
+    overview_source = source;
+    overview_sprites = tileset_sprites;
+    overview_styles_version = layer_styles_version;
+    return 0;
+}
+
+// picks the biggest sprites that let the camera fit in max_framew by max_frameh pixels,
+// and points the view at the overview when not even the smallest ones do,
+// the tileset has to be ready and the view has to be the live one
+// \returns 0 on success
+static int set_view_scale(FrameView* view, int draw_all_layers){
+    for(int level = 0; level < tileset_mip_count; level+=1){
+        const SpriteMip* const mip = &tileset_mips[level];
+        if((int64_t) view->cameraw * mip->tilew <= max_framew && (int64_t) view->camerah * mip->tileh <= max_frameh){
+            view->sprite_level = level;
+            return 0;
+        }
+    }
+    if(update_overview(draw_all_layers)){
+        fprintf(stderr, "[ERROR] could not allocate map overview\n");
+        return 1;
+    }
+    int level = 0;
+    while(((view->cameraw - 1) >> level) + 1 > max_framew || ((view->camerah - 1) >> level) + 1 > max_frameh) level += 1;
+    // every level past the last one would be the same single pixel
+    const OverviewLevel* const overview = &overview_levels[(level < overview_level_count)? level : overview_level_count - 1];
+    view->overview        = overview->pixels;
+    view->overview_stride = overview->w;
+    view->overview_levelw = overview->w;
+    view->overview_levelh = overview->h;
+    view->overview_x      = ((view->camerax < 0)? 0 : view->camerax) >> level;
+    view->overview_y      = ((view->cameray < 0)? 0 : view->cameray) >> level;
+    view->overview_w      = ((view->cameraw - 1) >> level) + 1;
+    view->overview_h      = ((view->camerah - 1) >> level) + 1;
+    return 0;
+}
+
+// the columns and rows of the view's overview window that are inside the map
+static inline void get_overview_window(const FrameView* view, int* columns, int* rows){
+    const int w = view->overview_levelw - view->overview_x;
+    const int h = view->overview_levelh - view->overview_y;
+    *columns = (w < 0)? 0 : (w < view->overview_w)? w : view->overview_w;
+    *rows    = (h < 0)? 0 : (h < view->overview_h)? h : view->overview_h;
+}
+
+// copies the overview window of the view into the framebuffer, what is past the map is black
+// \returns 0 on success
+static int draw_overview_frame(const FrameView* view, int* drawnw, int* drawnh){
+    framebuffer_scroll = 0;
+    // the cells of the last frame aren't in the framebuffer anymore
+    drawn_valid = 0;
+    if(resize_framebuffer(view->overview_w, view->overview_h)){
+        fprintf(stderr, "[ERRROR] can't draw graphical representation of map, could not create pixel buffer\n");
+        return 1;
+    }
+    int columns = 0;
+    int rows = 0;
+    get_overview_window(view, &columns, &rows);
+    for(int i = 0; i < pixelsh; i+=1){
+        uint32_t* const row = &pixels[(size_t) i * pixelsw];
+        int j = 0;
+        if(i < rows){
+            memcpy(row, &view->overview[(size_t) (view->overview_y + i) * view->overview_stride + view->overview_x], columns * sizeof(row[0]));
+            j = columns;
+        }
+        for(; j < pixelsw; j+=1) row[j] = 0xFF000000;
+    }
+    *drawnw = columns;
+    *drawnh = rows;
+    return 0;
+}
+
+// \returns 0 if the tileset can be drawn with, otherwise the display goes back to print_map
+static int require_tileset(void){
+    if(wait_tileset()){
         fprintf(stderr, "[ERROR] can't draw graphical representation of map, missing tileset, going back to standard\n");
         display = print_map;
-        return;
+        return 1;
     }
+    return 0;
+}
 
-    const int pixelsw = cameraw * tileset_tilew;
-    const int pixelsh = camerah * tileset_tileh;
-    const int pixels_stride = pixelsw;
+// draws the camera's view into the framebuffer, the tileset has to be ready
+// \returns 0 on success, drawnw and drawnh are set to the size of the part of the framebuffer the map covers
+static int draw_graphical_frame(const FrameView* view, int draw_all_layers, int* drawnw, int* drawnh){
 
-    uint32_t* pixels = malloc(pixelsw * pixelsh * sizeof(pixels[0]));
+    if(view->overview) return draw_overview_frame(view, drawnw, drawnh);
 
-    if(!pixels){
+    const SpriteMip* const mip = &tileset_mips[view->sprite_level];
+    framebuffer_scroll = 0;
+    if(resize_framebuffer(view->cameraw * mip->tilew, view->camerah * mip->tileh)){
         fprintf(stderr, "[ERRROR] can't draw graphical representation of map, could not create pixel buffer\n");
-        return ;
+        drawn_valid = 0;
+        return 1;
     }
 
-    for(int i = 0; i < cameraw * tileset_tilew * camerah * tileset_tileh; i+=1) pixels[i] = 0xFF000000;
+    const int depth = (!view->layers)? 0 : (draw_all_layers)? view->layers : 1;
+    const size_t cells = (size_t) view->cameraw * view->camerah * depth;
+    if(cells > drawn_cells_cap){
+        TILE* const ndrawn = realloc(drawn_cells, cells * sizeof(ndrawn[0]));
+        if(ndrawn) drawn_cells = ndrawn;
+        TILE* const nnext = (ndrawn)? realloc(next_cells, cells * sizeof(nnext[0])) : NULL;
+        if(!nnext){
+            fprintf(stderr, "[ERRROR] can't draw graphical representation of map, could not allocate cells\n");
+            drawn_valid = 0;
+            return 1;
+        }
+        next_cells = nnext;
+        drawn_cells_cap = cells;
+    }
 
-    const int i0 = (cameray < 0)? 0 : cameray;
-    const int j0 = (camerax < 0)? 0 : camerax;
-    const int irange = (cameray + camerah < maph)? cameray + camerah : maph;
-    const int jrange = (camerax + cameraw < mapw)? camerax + cameraw : mapw;
+    const int i0 = (view->cameray < 0)? 0 : view->cameray;
+    const int j0 = (view->camerax < 0)? 0 : view->camerax;
+    const int irange = (view->cameray + view->camerah < view->maph)? view->cameray + view->camerah : view->maph;
+    const int jrange = (view->camerax + view->cameraw < view->mapw)? view->camerax + view->cameraw : view->mapw;
+
+    GraphicalFrame frame = {view, mip, draw_all_layers, depth, (irange > i0)? irange - i0 : 0, (jrange > j0)? jrange - j0 : 0, 0, i0 - drawn_i0, j0 - drawn_j0};
+    const int styled = draw_all_layers && view->styles;
+    frame.reuse = drawn_valid && drawn_cameraw == view->cameraw && drawn_camerah == view->camerah && drawn_depth == depth
+        && drawn_sprites == mip->sprites && drawn_styles_version == view->styles_version && drawn_styled == styled
+        && abs(frame.di) < view->camerah && abs(frame.dj) < view->cameraw;
+    if(frame.reuse && (frame.di || frame.dj)){
+        shift_framebuffer(-frame.dj * mip->tilew, -frame.di * mip->tileh);
+        if(!frame.dj) framebuffer_scroll = frame.di * mip->tileh;
+    }
 
-    if(draw_all_layers){
-        for(int i = i0; i < irange; i+=1){
-            for(int j = j0; j < jrange; j+=1){
-                for(int k = layers - 1; k > -1; k-=1){
-                    render_tile_graphical(
-                        map[k][i * mapw + j],
-                        (j - j0) * tileset_tilew, (i - i0) * tileset_tileh,
-                        pixels, pixelsw, pixelsh, pixels_stride
-                    );
+    const int threads = (render_threads > 0)? render_threads : get_cpu_count();
+    if(threads > 1 && view->camerah > 1 && (size_t) pixelsw * pixelsh >= PARALLEL_RENDER_MIN_PIXELS){
+        if(!render_pool_started){
+            // the kernels have to be picked before several threads call them
+            blend_row(NULL, NULL, 0);
+            blend_scaled_row(NULL, NULL, 0, 0);
+            render_pool_started = !start_worker_pool(&render_pool, threads - 1);
+        }
+        if(render_pool_started){
+            // a few bands per thread so a slow band doesn't keep the others waiting
+            const int band_count = (view->camerah < threads * 4)? view->camerah : threads * 4;
+            run_worker_pool(&render_pool, draw_graphical_band, (void*) &frame, band_count);
+        }
+        else draw_graphical_rows(&frame, 0, view->camerah);
+    }
+    else draw_graphical_rows(&frame, 0, view->camerah);
+
+    TILE* const drawn = drawn_cells;
+    drawn_cells   = next_cells;
+    next_cells    = drawn;
+    drawn_valid   = 1;
+    drawn_i0      = i0;
+    drawn_j0      = j0;
+    drawn_rows    = frame.rows;
+    drawn_columns = frame.columns;
+    drawn_cameraw = view->cameraw;
+    drawn_camerah = view->camerah;
+    drawn_depth   = depth;
+    drawn_sprites = mip->sprites;
+    drawn_styles_version = view->styles_version;
+    drawn_styled  = styled;
+
+    *drawnw = frame.columns * mip->tilew;
+    *drawnh = frame.rows * mip->tileh;
+    return 0;
+}
+
+static void free_render_pool(void){
+    if(render_pool_started) stop_worker_pool(&render_pool);
+    render_pool_started = 0;
+}
+
+static ByteBuffer ascii_frame;
+
+// \returns the tile that covers the whole map cell in the frame, or -1 if it's made of more than one
+static inline int get_covering_tile(const FrameView* view, int draw_all_layers, int i, int j){
+    if(!draw_all_layers){
+        const TILE tile = get_view_tile(view, view->current_layer, i, j);
+        return (get_tile_opacity(tile) == TILE_OPAQUE)? (int) tile : -1;
+    }
+    for(int k = 0; k < view->layers; k+=1){
+        const TILE tile = get_view_tile(view, k, i, j);
+        const int opacity = get_layer_tile_opacity(view->styles, k, tile);
+        // the glyphs are of the sprites' own colors
+        if(opacity == TILE_OPAQUE) return (view->styles && view->styles[k].factors != LAYER_STYLE_PLAIN)? -1 : (int) tile;
+        if(opacity == TILE_MIXED) return -1;
+    }
+    return -1;
+}
+
+// the drawn part of the framebuffer as ascii art into ascii_frame, one line per pixel row,
+// cells covered by an opaque tile copy its cached glyphs and the rest is converted from the framebuffer
+// \returns 0 on success
+static int build_ascii_frame(const FrameView* view, int draw_all_layers, int w, int h){
+    if(update_tileset_glyphs()) return 1;
+    const size_t line = (size_t) w + 1;
+    ascii_frame.size = 0;
+    if(reserve_bytes(&ascii_frame, line * h)) return 1;
+    ascii_frame.size = line * h;
+    char* const text = ascii_frame.data;
+    for(int i = 0; i < h; i+=1) text[i * line + w] = '\n';
+
+    // the cached glyphs are of the full size sprites
+    if(view->overview || view->sprite_level){
+        for(int i = 0; i < h; i+=1) get_ascii_row(&text[i * line], &pixels[(size_t) i * pixelsw], w);
+        return 0;
+    }
+
+    const int i0 = (view->cameray < 0)? 0 : view->cameray;
+    const int j0 = (view->camerax < 0)? 0 : view->camerax;
+    const size_t sprite_size = (size_t) tileset_tilew * tileset_tileh;
+    for(int y = 0; y < h; y+=tileset_tileh){
+        for(int x = 0; x < w; x+=tileset_tilew){
+            const int tile = get_covering_tile(view, draw_all_layers, i0 + y / tileset_tileh, j0 + x / tileset_tilew);
+            if(tile < 0){
+                for(int r = 0; r < tileset_tileh; r+=1){
+                    get_ascii_row(&text[(y + r) * line + x], &pixels[(size_t) (y + r) * pixelsw + x], tileset_tilew);
                 }
+                continue;
+            }
+            const char* const glyphs = &tileset_glyphs[(((TILE) tile <= (TILE) tileset_tile_count)? (size_t) tile : 0) * sprite_size];
+            for(int r = 0; r < tileset_tileh; r+=1){
+                memcpy(&text[(y + r) * line + x], &glyphs[r * tileset_tilew], tileset_tilew);
             }
         }
     }
-    else{
-        for(int i = i0; i < irange; i+=1){
-            for(int j = j0; j < jrange; j+=1){
-                render_tile_graphical(
-                    map[current_layer][i * mapw + j],
-                    (j - j0) * tileset_tilew, (i - i0) * tileset_tileh,
-                    pixels, pixelsw, pixelsh, pixels_stride
-                );
+    return 0;
+}
+
+// the frame the image output holds
+static uint64_t   image_frame_hash;
+static int        image_frame_valid = 0;
+
+// the encoded image output, kept between frames so the encoders don't allocate every time
+static ByteBuffer image_frame;
+static int        image_frame_error = 0;
+
+static void push_image_bytes(void* context, void* data, int size){
+    ByteBuffer* const buffer = (ByteBuffer*) context;
+    if(size < 0 || reserve_bytes(buffer, (size_t) size)){
+        image_frame_error = 1;
+        return ;
+    }
+    push_bytes(buffer, (const char*) data, (size_t) size);
+}
+
+static inline void push_be32(ByteBuffer* buffer, uint32_t value){
+    push_byte(buffer, (char) (value >> 24));
+    push_byte(buffer, (char) (value >> 16));
+    push_byte(buffer, (char) (value >>  8));
+    push_byte(buffer, (char) (value >>  0));
+}
+
+#define QOI_OP_INDEX 0x00
+#define QOI_OP_DIFF  0x40
+#define QOI_OP_LUMA  0x80
+#define QOI_OP_RUN   0xC0
+#define QOI_OP_RGB   0xFE
+#define QOI_OP_RGBA  0xFF
+
+// "the quite ok image format", encodes about as fast as it copies and the previews it makes are a lot smaller than a bitmap
+// \returns 0 on success
+static int push_qoi_image(ByteBuffer* buffer, const uint32_t* src, int w, int h, int stride){
+    if(reserve_bytes(buffer, 14 + (size_t) w * h * 5 + 8)) return 1;
+    push_bytes(buffer, "qoif", 4);
+    push_be32(buffer, (uint32_t) w);
+    push_be32(buffer, (uint32_t) h);
+    push_byte(buffer, 4);
+    push_byte(buffer, 0);
+
+    uint32_t seen[64] = {0};
+    uint32_t prev = 0xFF000000;
+    int run = 0;
+    for(int i = 0; i < h; i+=1){
+        const uint32_t* const row = &src[(size_t) i * stride];
+        for(int j = 0; j < w; j+=1){
+            const uint32_t color = row[j];
+            if(color == prev){
+                run += 1;
+                if(run == 62){
+                    push_byte(buffer, (char) (QOI_OP_RUN | (run - 1)));
+                    run = 0;
+                }
+                continue;
             }
+            if(run){
+                push_byte(buffer, (char) (QOI_OP_RUN | (run - 1)));
+                run = 0;
+            }
+            const int r = (color >>  0) & 0xFF;
+            const int g = (color >>  8) & 0xFF;
+            const int b = (color >> 16) & 0xFF;
+            const int a = (color >> 24) & 0xFF;
+            const int slot = (r * 3 + g * 5 + b * 7 + a * 11) & 63;
+            if(seen[slot] == color){
+                push_byte(buffer, (char) (QOI_OP_INDEX | slot));
+            }
+            else if(a != (int) (prev >> 24)){
+                seen[slot] = color;
+                push_byte(buffer, (char) QOI_OP_RGBA);
+                push_byte(buffer, (char) r);
+                push_byte(buffer, (char) g);
+                push_byte(buffer, (char) b);
+                push_byte(buffer, (char) a);
+            }
+            else{
+                seen[slot] = color;
+                const int dr = (int8_t) (r - (int) ((prev >>  0) & 0xFF));
+                const int dg = (int8_t) (g - (int) ((prev >>  8) & 0xFF));
+                const int db = (int8_t) (b - (int) ((prev >> 16) & 0xFF));
+                const int dr_dg = dr - dg;
+                const int db_dg = db - dg;
+                if(dr > -3 && dr < 2 && dg > -3 && dg < 2 && db > -3 && db < 2){
+                    push_byte(buffer, (char) (QOI_OP_DIFF | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2)));
+                }
+                else if(dg > -33 && dg < 32 && dr_dg > -9 && dr_dg < 8 && db_dg > -9 && db_dg < 8){
+                    push_byte(buffer, (char) (QOI_OP_LUMA | (dg + 32)));
+                    push_byte(buffer, (char) ((dr_dg + 8) << 4 | (db_dg + 8)));
+                }
+                else{
+                    push_byte(buffer, (char) QOI_OP_RGB);
+                    push_byte(buffer, (char) r);
+                    push_byte(buffer, (char) g);
+                    push_byte(buffer, (char) b);
+                }
+            }
+            prev = color;
         }
     }
+    if(run) push_byte(buffer, (char) (QOI_OP_RUN | (run - 1)));
+    push_bytes(buffer, "\0\0\0\0\0\0\0\1", 8);
+    return 0;
+}
 
-    if(is_png_extension(output_path)){
-        if(output) fclose(output);
-        output = NULL;
-        if(!stbi_write_png(output_path, pixelsw, pixelsh, (int) sizeof(pixels[0]), pixels, pixels_stride * (int) sizeof(pixels[0]))){
-            fprintf(stderr, "[ERROR] could not render graphical representation to '%s'\n", output_path);
+// encodes the whole framebuffer into image_frame
+// \returns 0 on success
+static int encode_image_frame(int format){
+    const int w = pixelsw;
+    const int h = pixelsh;
+    image_frame.size = 0;
+    image_frame_error = 0;
+    switch(format){
+    case IMAGE_PNG:
+        if(!stbi_write_png_to_func(push_image_bytes, &image_frame, w, h, 4, pixels, w * (int) sizeof(pixels[0]))) return 1;
+        break;
+    case IMAGE_BMP:
+        if(!stbi_write_bmp_to_func(push_image_bytes, &image_frame, w, h, 4, pixels)) return 1;
+        break;
+    case IMAGE_TGA:
+        if(!stbi_write_tga_to_func(push_image_bytes, &image_frame, w, h, 4, pixels)) return 1;
+        break;
+    case IMAGE_PPM:{
+        char header[64];
+        const int header_len = snprintf(header, sizeof(header), "P6\n%i %i\n255\n", w, h);
+        if(reserve_bytes(&image_frame, header_len + (size_t) w * h * 3)) return 1;
+        push_bytes(&image_frame, header, header_len);
+        for(size_t i = 0; i < (size_t) w * h; i+=1){
+            push_byte(&image_frame, (char) ((pixels[i] >>  0) & 0xFF));
+            push_byte(&image_frame, (char) ((pixels[i] >>  8) & 0xFF));
+            push_byte(&image_frame, (char) ((pixels[i] >> 16) & 0xFF));
         }
     }
-    else{
-        if(output && output != stdout){
-            fclose(output);
-            output = NULL;
-            output = fopen(output_path, "w");
+        break;
+    case IMAGE_PAM:{
+        char header[128];
+        const int header_len = snprintf(header, sizeof(header), "P7\nWIDTH %i\nHEIGHT %i\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n", w, h);
+        if(reserve_bytes(&image_frame, header_len + (size_t) w * h * sizeof(pixels[0]))) return 1;
+        push_bytes(&image_frame, header, header_len);
+        // 0xAABBGGRR is already r, g, b, a in memory
+        push_bytes(&image_frame, (const char*) pixels, (size_t) w * h * sizeof(pixels[0]));
+    }
+        break;
+    case IMAGE_QOI:
+        if(push_qoi_image(&image_frame, pixels, w, h, pixelsw)) return 1;
+        break;
+    default:
+        return 1;
+    }
+    return image_frame_error;
+}
+
+// \returns 0 on success
+static int write_image_frame(int format){
+    if(encode_image_frame(format)) return 1;
+    FILE* const f = fopen(output_path, "wb");
+    if(!f) return 1;
+    const int err = write_bytes(&image_frame, f);
+    return fclose(f) || err;
+}
+
+// an output of shm:<name> publishes the framebuffer into the posix shared memory object name, made of this header
+// followed by two buffers of 0xAABBGGRR pixels premultiplied over black, rows of width pixels with no padding,
+// a viewer maps the object, reads front and shows that buffer straight from the mapping, the other one is written meanwhile,
+// a frame that doesn't fit replaces the object with a bigger one under the same name, the old one's magic is zeroed
+// first, so a viewer that sees it gone opens the name again
+#define SHARED_FRAME_MAGIC 0x4246444D // "MDFB" in memory
+
+typedef struct SharedFrameBuffer {
+    // the frame the buffer holds, 0 while it is being written, a viewer that sees it change while reading has a torn frame
+    volatile uint64_t frame;
+    uint32_t          width;
+    uint32_t          height;
+    // the pixels that changed since the frame before, all of them if the size changed
+    uint32_t          dirty_x;
+    uint32_t          dirty_y;
+    uint32_t          dirty_w;
+    uint32_t          dirty_h;
+} SharedFrameBuffer;
+
+typedef struct SharedFrameHeader {
+    volatile uint32_t magic;
+    uint32_t          header_size;
+    // the size of the whole object
+    volatile uint64_t segment_size;
+    // buffer i starts header_size + i * buffer_size bytes into the object
+    volatile uint64_t buffer_size;
+    // the frames published so far and the buffer that holds the last one
+    volatile uint64_t frame;
+    volatile uint32_t front;
+    uint32_t          reserved;
+    SharedFrameBuffer buffers[2];
+} SharedFrameHeader;
+
+static SharedMemory shared_frame;
+static const char*  shared_frame_name;
+
+static uint32_t* get_shared_frame_pixels(int buffer){
+    const SharedFrameHeader* const header = (const SharedFrameHeader*) shared_frame.data;
+    return (uint32_t*) ((char*) shared_frame.data + header->header_size + buffer * header->buffer_size);
+}
+
+// creates the object the first time and replaces it when a w by h frame doesn't fit
+// \returns 0 on success
+static int reserve_shared_frame(const char* name, int w, int h){
+    const size_t buffer_size = (size_t) w * h * sizeof(pixels[0]);
+    SharedFrameHeader* header = (SharedFrameHeader*) shared_frame.data;
+    if(header && header->buffer_size >= buffer_size) return 0;
+
+    if(header){
+        // the object is replaced, a viewer that is reading it sees the frame torn and the magic gone
+        header->buffers[0].frame = 0;
+        header->buffers[1].frame = 0;
+        memory_barrier();
+        header->magic = 0;
+        memory_barrier();
+    }
+    const uint64_t frame = (header)? header->frame : 0;
+    if(map_shared_memory(&shared_frame, name, sizeof(SharedFrameHeader) + 2 * buffer_size)) return 1;
+    shared_frame_name = name;
+    header = (SharedFrameHeader*) shared_frame.data;
+    memset(header, 0, sizeof(*header));
+    header->magic        = SHARED_FRAME_MAGIC;
+    header->header_size  = sizeof(SharedFrameHeader);
+    header->buffer_size  = buffer_size;
+    header->frame        = frame;
+    memory_barrier();
+    header->segment_size = shared_frame.size;
+    return 0;
+}
+
+// the rect of the pixels that differ between two w by h frames
+static DirtyRect diff_frames(const uint32_t* a, const uint32_t* b, int w, int h){
+    DirtyRect rect = {0, 0, 0, 0};
+    for(int i = 0; i < h; i+=1){
+        const uint32_t* const ra = &a[(size_t) i * w];
+        const uint32_t* const rb = &b[(size_t) i * w];
+        if(!memcmp(ra, rb, w * sizeof(ra[0]))) continue;
+        int j0 = 0;
+        int j1 = w;
+        while(ra[j0] == rb[j0]) j0 += 1;
+        while(ra[j1 - 1] == rb[j1 - 1]) j1 -= 1;
+        add_dirty_rect(&rect, j0, i, j1, i + 1);
+    }
+    return rect;
+}
+
+// writes the framebuffer into the buffer viewers aren't shown and makes it the front one, the back buffer holds the frame
+// from two frames ago, so only what changed since then is copied, which is the dirty rect of the front buffer and of this frame
+// \returns 0 on success
+static int publish_shared_frame(const char* name){
+    const int w = pixelsw;
+    const int h = pixelsh;
+    if(reserve_shared_frame(name, w, h)) return 1;
+
+    SharedFrameHeader* const header = (SharedFrameHeader*) shared_frame.data;
+    const int front = (int) header->front;
+    const int back = !front;
+    SharedFrameBuffer* const last = &header->buffers[front];
+    SharedFrameBuffer* const next = &header->buffers[back];
+    uint32_t* const dst = get_shared_frame_pixels(back);
+    // a buffer that doesn't hold a whole frame of this size is written over
+    const int same_size = last->frame && next->frame && last->width == (uint32_t) w && last->height == (uint32_t) h && next->width == (uint32_t) w && next->height == (uint32_t) h;
+
+    DirtyRect dirty = {0, 0, w, h};
+    DirtyRect copy  = dirty;
+    if(same_size){
+        dirty = diff_frames(get_shared_frame_pixels(front), pixels, w, h);
+        copy = dirty;
+        if(last->dirty_w && last->dirty_h){
+            add_dirty_rect(&copy, last->dirty_x, last->dirty_y, last->dirty_x + last->dirty_w, last->dirty_y + last->dirty_h);
         }
-        if(!output){
-            fprintf(stderr, "[ERROR] could not open output '%s', switching back to stdout\n", output_path);
-            output = stdout;
-            free(pixels);
+    }
+    else if(last->frame && last->width == (uint32_t) w && last->height == (uint32_t) h){
+        dirty = diff_frames(get_shared_frame_pixels(front), pixels, w, h);
+    }
+
+    next->frame = 0;
+    memory_barrier();
+    for(int i = copy.y0; i < copy.y1; i+=1){
+        memcpy(&dst[(size_t) i * w + copy.x0], &pixels[(size_t) i * w + copy.x0], (copy.x1 - copy.x0) * sizeof(pixels[0]));
+    }
+    next->width   = w;
+    next->height  = h;
+    next->dirty_x = dirty.x0;
+    next->dirty_y = dirty.y0;
+    next->dirty_w = dirty.x1 - dirty.x0;
+    next->dirty_h = dirty.y1 - dirty.y0;
+    memory_barrier();
+    next->frame = header->frame + 1;
+    header->front = back;
+    memory_barrier();
+    header->frame += 1;
+    return 0;
+}
+
+// unmaps the shared framebuffer and removes its name, viewers keep what they map
+static void close_shared_frame(void){
+    unmap_shared_memory(&shared_frame, shared_frame_name);
+    shared_frame_name = NULL;
+}
+
+// the graphical frame into the output image, or as ascii art into the text output
+static void draw_graphical_file(const FrameView* view, int draw_all_layers){
+
+    int drawnw = 0;
+    int drawnh = 0;
+    if(draw_graphical_frame(view, draw_all_layers, &drawnw, &drawnh)) return ;
+
+    const int image_format = get_image_format(output_path);
+    if(image_format != IMAGE_NONE){
+        // hashing the framebuffer costs a small fraction of encoding it
+        const uint64_t hash = hash_bytes(pixels, (size_t) pixelsw * pixelsh * sizeof(pixels[0])) ^ ((uint64_t) pixelsw << 32 | (uint32_t) pixelsh);
+        if(image_frame_valid && hash == image_frame_hash){
+            skipped_frames += 1;
             return ;
         }
-        if(output == stdout){
-            printf("\x1B[2J\x1B[H\n");
-            for(int i = 0; i < (irange - i0) * tileset_tileh; i+=1){
-                for(int j = 0; j < (jrange - j0) * tileset_tilew; j+=1){
-                    put_color_char(pixels[i * pixels_stride + j]);
+        image_frame_valid = 0;
+        if((image_format == IMAGE_SHM)? publish_shared_frame(&output_path[4]) : write_image_frame(image_format)){
+            fprintf(stderr, "[ERROR] could not render graphical representation to '%s'\n", output_path);
+            return ;
+        }
+        image_frame_hash = hash;
+        image_frame_valid = 1;
+    }
+    else if(!build_ascii_frame(view, draw_all_layers, drawnw, drawnh)){
+        present_file_frame(&ascii_frame, output);
+    }
+    else{
+        fprintf(stderr, "[ERROR] could not allocate ascii frame\n");
+    }
+}
+
+// a zlib stream made of one fixed huffman block that is fed a piece at a time, so an image can be compressed
+// without ever being whole in memory, matches are looked for in the last DEFLATE_WINDOW bytes
+#define DEFLATE_WINDOW    32768
+#define DEFLATE_BUFFER    (3 * DEFLATE_WINDOW)
+#define DEFLATE_HASH_BITS 15
+#define DEFLATE_MAX_CHAIN 32
+#define DEFLATE_MIN_MATCH 3
+#define DEFLATE_MAX_MATCH 258
+
+typedef struct DeflateStream {
+    // the compressed bytes are pushed here, the caller takes them out whenever it wants
+    ByteBuffer* out;
+    uint32_t    bits;
+    int         bitcount;
+    uint32_t    adler_a;
+    uint32_t    adler_b;
+    // the window followed by the bytes not compressed yet, buffer[0] is byte base of the stream
+    uint8_t*    buffer;
+    int         buffer_len;
+    int         pos;
+    int64_t     base;
+    // stream positions of the last byte triple with a hash and of the one before with the same hash, -1 if none
+    int64_t*    head;
+    int64_t*    prev;
+} DeflateStream;
+
+static const uint16_t deflate_length_base[30] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258, 259
+};
+static const uint8_t  deflate_length_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t deflate_distance_base[31] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769,
+    1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577, 32769
+};
+static const uint8_t  deflate_distance_extra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+// deflate packs values from the least significant bit up
+static inline void put_deflate_bits(DeflateStream* z, uint32_t value, int count){
+    z->bits |= value << z->bitcount;
+    z->bitcount += count;
+    while(z->bitcount >= 8){
+        push_byte(z->out, (char) (z->bits & 0xFF));
+        z->bits >>= 8;
+        z->bitcount -= 8;
+    }
+}
+
+// but huffman codes from the most significant one down
+static inline void put_deflate_code(DeflateStream* z, uint32_t code, int count){
+    uint32_t reversed = 0;
+    for(int i = 0; i < count; i+=1) reversed |= ((code >> i) & 1) << (count - 1 - i);
+    put_deflate_bits(z, reversed, count);
+}
+
+// a literal byte, 256 for the end of the block or 257 and up for a length, with the fixed codes
+static inline void put_deflate_symbol(DeflateStream* z, int symbol){
+    if(symbol < 144)      put_deflate_code(z, 0x30 + symbol, 8);
+    else if(symbol < 256) put_deflate_code(z, 0x190 + symbol - 144, 9);
+    else if(symbol < 280) put_deflate_code(z, symbol - 256, 7);
+    else                  put_deflate_code(z, 0xC0 + symbol - 280, 8);
+}
+
+static void put_deflate_match(DeflateStream* z, int length, int distance){
+    int l = 0;
+    for(; deflate_length_base[l + 1] <= length; l+=1);
+    put_deflate_symbol(z, 257 + l);
+    put_deflate_bits(z, length - deflate_length_base[l], deflate_length_extra[l]);
+    int d = 0;
+    for(; deflate_distance_base[d + 1] <= distance; d+=1);
+    put_deflate_code(z, d, 5);
+    put_deflate_bits(z, distance - deflate_distance_base[d], deflate_distance_extra[d]);
+}
+
+static inline uint32_t deflate_hash(const uint8_t* bytes){
+    const uint32_t triple = (uint32_t) bytes[0] << 16 | (uint32_t) bytes[1] << 8 | bytes[2];
+    return (triple * 2654435761u) >> (32 - DEFLATE_HASH_BITS);
+}
+
+static inline void insert_deflate_hash(DeflateStream* z, int pos){
+    if(pos + DEFLATE_MIN_MATCH > z->buffer_len) return ;
+    const uint32_t hash = deflate_hash(&z->buffer[pos]);
+    z->prev[(z->base + pos) & (DEFLATE_WINDOW - 1)] = z->head[hash];
+    z->head[hash] = z->base + pos;
+}
+
+// compresses the buffered bytes up to end, the matches may run past it
+// \returns 0 on success
+static int compress_deflate(DeflateStream* z, int end){
+    if(end <= z->pos) return 0;
+    // a match of 3 bytes is the worst case at 31 bits
+    if(reserve_bytes(z->out, (size_t) (end - z->pos) * 11 / 8 + 16)) return 1;
+    const uint8_t* const buffer = z->buffer;
+    while(z->pos < end){
+        const int pos = z->pos;
+        const int max_length = (z->buffer_len - pos < DEFLATE_MAX_MATCH)? z->buffer_len - pos : DEFLATE_MAX_MATCH;
+        int length = 0;
+        int distance = 0;
+        if(max_length >= DEFLATE_MIN_MATCH){
+            int64_t candidate = z->head[deflate_hash(&buffer[pos])];
+            for(int chain = 0; chain < DEFLATE_MAX_CHAIN && candidate >= 0 && z->base + pos - candidate <= DEFLATE_WINDOW; chain+=1){
+                const uint8_t* const match = &buffer[candidate - z->base];
+                if(match[length] == buffer[pos + length]){
+                    int l = 0;
+                    for(; l < max_length && match[l] == buffer[pos + l]; l+=1);
+                    if(l > length){
+                        length = l;
+                        distance = (int) (z->base + pos - candidate);
+                        if(l == max_length) break;
+                    }
                 }
-                fprintf(output, "\n");
+                candidate = z->prev[candidate & (DEFLATE_WINDOW - 1)];
             }
         }
+        if(length >= DEFLATE_MIN_MATCH){
+            put_deflate_match(z, length, distance);
+            for(int i = 0; i < length; i+=1) insert_deflate_hash(z, pos + i);
+            z->pos += length;
+        }
         else{
-            for(int i = 0; i < (irange - i0) * tileset_tileh; i+=1){
-                for(int j = 0; j < (jrange - j0) * tileset_tilew; j+=1){
-                    fprintf(output, "%c", ascii_map[getascii_color_index(pixels[i * pixels_stride + j])]);
+            put_deflate_symbol(z, buffer[pos]);
+            insert_deflate_hash(z, pos);
+            z->pos += 1;
+        }
+    }
+    return 0;
+}
+
+// \returns 0 on success
+static int start_deflate(DeflateStream* z, ByteBuffer* out){
+    memset(z, 0, sizeof(*z));
+    z->out = out;
+    z->adler_a = 1;
+    z->buffer = malloc(DEFLATE_BUFFER);
+    z->head = malloc(((size_t) 1 << DEFLATE_HASH_BITS) * sizeof(z->head[0]));
+    z->prev = malloc(DEFLATE_WINDOW * sizeof(z->prev[0]));
+    if(!z->buffer || !z->head || !z->prev || reserve_bytes(out, 3)) return 1;
+    for(int i = 0; i < 1 << DEFLATE_HASH_BITS; i+=1) z->head[i] = -1;
+    // 32k window, no dictionary and the fastest compression level as the check bits say
+    push_byte(out, 0x78);
+    push_byte(out, 0x01);
+    // the last block, with the fixed codes
+    put_deflate_bits(z, 1, 1);
+    put_deflate_bits(z, 1, 2);
+    return 0;
+}
+
+// \returns 0 on success
+static int push_deflate(DeflateStream* z, const uint8_t* data, size_t size){
+    // adler32, the sums can go 5552 bytes before they have to be reduced
+    for(size_t i = 0; i < size; ){
+        const size_t n = (size - i < 5552)? size - i : 5552;
+        for(const size_t end = i + n; i < end; i+=1){
+            z->adler_a += data[i];
+            z->adler_b += z->adler_a;
+        }
+        z->adler_a %= 65521;
+        z->adler_b %= 65521;
+    }
+    while(size){
+        const int n = (size < (size_t) (DEFLATE_BUFFER - z->buffer_len))? (int) size : DEFLATE_BUFFER - z->buffer_len;
+        memcpy(&z->buffer[z->buffer_len], data, n);
+        z->buffer_len += n;
+        data += n;
+        size -= n;
+        // keeps the longest match in sight
+        if(compress_deflate(z, z->buffer_len - DEFLATE_MAX_MATCH)) return 1;
+        if(z->buffer_len == DEFLATE_BUFFER){
+            const int drop = z->pos - DEFLATE_WINDOW;
+            memmove(z->buffer, &z->buffer[drop], z->buffer_len - drop);
+            z->buffer_len -= drop;
+            z->pos -= drop;
+            z->base += drop;
+        }
+    }
+    return 0;
+}
+
+// compresses what is left and ends the stream
+// \returns 0 on success
+static int finish_deflate(DeflateStream* z){
+    if(compress_deflate(z, z->buffer_len) || reserve_bytes(z->out, 8)) return 1;
+    put_deflate_symbol(z, 256);
+    if(z->bitcount) put_deflate_bits(z, 0, 8 - z->bitcount);
+    push_be32(z->out, z->adler_b << 16 | z->adler_a);
+    return 0;
+}
+
+static void free_deflate(DeflateStream* z){
+    free(z->buffer);
+    free(z->head);
+    free(z->prev);
+    z->buffer = NULL;
+    z->head = NULL;
+    z->prev = NULL;
+}
+
+// the length is filled in by end_png_chunk
+// \returns where the chunk starts
+static size_t begin_png_chunk(ByteBuffer* buffer, const char* type){
+    const size_t start = buffer->size;
+    if(reserve_bytes(buffer, 8)) return start;
+    push_be32(buffer, 0);
+    push_bytes(buffer, type, 4);
+    return start;
+}
+
+// \returns 0 on success
+static int end_png_chunk(ByteBuffer* buffer, size_t start){
+    if(buffer->size < start + 8 || reserve_bytes(buffer, 4)) return 1;
+    const size_t length = buffer->size - start - 8;
+    const size_t size = buffer->size;
+    buffer->size = start;
+    push_be32(buffer, (uint32_t) length);
+    buffer->size = size;
+    push_be32(buffer, stbiw__crc32((unsigned char*) &buffer->data[start + 4], (int) length + 4));
+    return 0;
+}
+
+// the export is drawn a row of cells at a time into a band with the last pixel row of the band before on top,
+// which is what the png filters of the first row look at
+typedef struct ExportBand {
+    int       format;
+    int       w;
+    uint32_t* pixels;
+    TILE*     tiles;
+    uint8_t*  row;
+    ByteBuffer    chunk;
+    DeflateStream z;
+} ExportBand;
+
+// \returns 0 on success
+static int write_export_header(ExportBand* band, FILE* f, int w, int h){
+    char header[128];
+    int header_len = 0;
+    switch(band->format){
+    case IMAGE_PNG:{
+        static const char signature[8] = {(char) 137, 'P', 'N', 'G', '\r', '\n', 26, '\n'};
+        band->chunk.size = 0;
+        if(reserve_bytes(&band->chunk, 8 + 25)) return 1;
+        push_bytes(&band->chunk, signature, 8);
+        const size_t start = begin_png_chunk(&band->chunk, "IHDR");
+        push_be32(&band->chunk, (uint32_t) w);
+        push_be32(&band->chunk, (uint32_t) h);
+        // 8 bit rgba, deflate, the adaptive filters and no interlacing
+        push_bytes(&band->chunk, "\x08\x06\x00\x00\x00", 5);
+        if(end_png_chunk(&band->chunk, start)) return 1;
+        return write_bytes(&band->chunk, f);
+    }
+    case IMAGE_PPM:
+        header_len = snprintf(header, sizeof(header), "P6\n%i %i\n255\n", w, h);
+        break;
+    case IMAGE_PAM:
+        header_len = snprintf(header, sizeof(header), "P7\nWIDTH %i\nHEIGHT %i\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n", w, h);
+        break;
+    default:
+        return 1;
+    }
+    return fwrite(header, 1, header_len, f) != (size_t) header_len;
+}
+
+// writes the rows 1 up to h + 1 of the band, first says whether the band holds the first rows of the image
+// \returns 0 on success
+static int write_export_rows(ExportBand* band, FILE* f, int h, int first){
+    const int w = band->w;
+    const size_t row_bytes = (size_t) w * sizeof(band->pixels[0]);
+    switch(band->format){
+    case IMAGE_PNG:{
+        band->chunk.size = 0;
+        const size_t start = begin_png_chunk(&band->chunk, "IDAT");
+        if(first && start_deflate(&band->z, &band->chunk)) return 1;
+        unsigned char* const bytes = (unsigned char*) band->pixels;
+        signed char* const line = (signed char*) band->row;
+        for(int y = 1; y <= h; y+=1){
+            // the same filter choice as stb, the one with the smallest sum of differences
+            const int image_y = (first && y == 1)? 0 : y;
+            unsigned char* const rows = (image_y)? bytes : &bytes[row_bytes];
+            int best_filter = 0;
+            int64_t best_sum = INT64_MAX;
+            for(int filter = 0; filter < 5; filter+=1){
+                stbiw__encode_png_line(rows, (int) row_bytes, w, h + 1, image_y, 4, filter, line);
+                int64_t sum = 0;
+                for(size_t i = 0; i < row_bytes; i+=1) sum += abs(line[i]);
+                if(sum < best_sum){
+                    best_sum = sum;
+                    best_filter = filter;
                 }
-                fprintf(output, "\n");
             }
+            stbiw__encode_png_line(rows, (int) row_bytes, w, h + 1, image_y, 4, best_filter, line);
+            const uint8_t filter_byte = (uint8_t) best_filter;
+            if(push_deflate(&band->z, &filter_byte, 1) || push_deflate(&band->z, (const uint8_t*) line, row_bytes)) return 1;
+        }
+        if(band->chunk.size == start + 8) return 0;
+        return end_png_chunk(&band->chunk, start) || write_bytes(&band->chunk, f);
+    }
+    case IMAGE_PPM:
+        for(int y = 1; y <= h; y+=1){
+            const uint32_t* const src = &band->pixels[(size_t) y * w];
+            for(int x = 0; x < w; x+=1){
+                band->row[x * 3 + 0] = (uint8_t) (src[x] >>  0);
+                band->row[x * 3 + 1] = (uint8_t) (src[x] >>  8);
+                band->row[x * 3 + 2] = (uint8_t) (src[x] >> 16);
+            }
+            if(fwrite(band->row, 3, w, f) != (size_t) w) return 1;
         }
+        return 0;
+    case IMAGE_PAM:
+        // 0xAABBGGRR is already r, g, b, a in memory
+        return fwrite(&band->pixels[w], row_bytes, h, f) != (size_t) h;
+    default:
+        return 1;
     }
+}
 
+// \returns 0 on success
+static int finish_export(ExportBand* band, FILE* f){
+    if(band->format != IMAGE_PNG) return 0;
+    band->chunk.size = 0;
+    size_t start = begin_png_chunk(&band->chunk, "IDAT");
+    if(finish_deflate(&band->z) || end_png_chunk(&band->chunk, start)) return 1;
+    start = begin_png_chunk(&band->chunk, "IEND");
+    return end_png_chunk(&band->chunk, start) || write_bytes(&band->chunk, f);
+}
 
-    free(pixels);
+// draws the cells x up to x + w of every layer of the map row i into the band
+static void draw_export_band(ExportBand* band, int i, int x, int w){
+    uint32_t* const dst = &band->pixels[band->w];
+    for(int j = 0; j < w; j+=1){
+        for(int k = 0; k < layers; k+=1) band->tiles[k] = map[k][(size_t) i * mapw + x + j];
+        draw_graphical_cell(&tileset_mips[0], band->tiles, layers, get_layer_styles(), j * tileset_tilew, 0, dst, band->w, tileset_tileh);
+    }
 }
 
+// renders the w by h cells at x, y with all layers to a png, ppm or pam image at path,
+// a row of cells at a time, so it takes the same memory for any height and the map never has to fit in the framebuffer
+// \returns 0 on success
+static int export_map(const char* path, int x, int y, int w, int h){
+    ExportBand band = {0};
+    band.format = get_image_format(path);
+    if(band.format != IMAGE_PNG && band.format != IMAGE_PPM && band.format != IMAGE_PAM){
+        fprintf(stderr, "[ERROR] can only export to .png, .ppm or .pam, got '%s'\n", path);
+        return 1;
+    }
+    if(w <= 0 || h <= 0 || x < 0 || y < 0 || x >= mapw || y >= maph || w > mapw - x || h > maph - y){
+        fprintf(stderr, "[ERROR] can't export (%i, %i, %i, %i), the map is only (%i, %i)\n", x, y, w, h, mapw, maph);
+        return 1;
+    }
+    if(wait_tileset()){
+        fprintf(stderr, "[ERROR] can't export map, missing tileset\n");
+        return 1;
+    }
+    if((int64_t) w * tileset_tilew > 0x7FFFFFFF / 4 || (int64_t) h * tileset_tileh > 0x7FFFFFFF){
+        fprintf(stderr, "[ERROR] can't export (%i, %i) cells, the image would be too big\n", w, h);
+        return 1;
+    }
 
-static void render_terminal_and_graphics(int draw_all_layers){
+    band.w = w * tileset_tilew;
+    band.pixels = calloc((size_t) band.w * (tileset_tileh + 1), sizeof(band.pixels[0]));
+    band.tiles = malloc((layers + 1) * sizeof(band.tiles[0]));
+    band.row = malloc((size_t) band.w * sizeof(band.pixels[0]));
+    FILE* const f = fopen(path, "wb");
+    int err = !band.pixels || !band.tiles || !band.row || !f;
+    if(!f) fprintf(stderr, "[ERROR] could not open '%s'\n", path);
+    else if(err) fprintf(stderr, "[ERROR] could not allocate export band\n");
+
+    if(!err) err = write_export_header(&band, f, band.w, h * tileset_tileh);
+    for(int i = 0; i < h && !err; i+=1){
+        if(i) memcpy(band.pixels, &band.pixels[(size_t) band.w * tileset_tileh], (size_t) band.w * sizeof(band.pixels[0]));
+        draw_export_band(&band, y + i, x, w);
+        err = write_export_rows(&band, f, tileset_tileh, !i);
+    }
+    if(!err) err = finish_export(&band, f);
+    if(f && fclose(f)) err = 1;
+    if(err && f) fprintf(stderr, "[ERROR] could not export map to '%s'\n", path);
+
+    free_deflate(&band.z);
+    free_bytes(&band.chunk);
+    free(band.pixels);
+    free(band.tiles);
+    free(band.row);
+    return err;
+}
 
-    FILE* const saved_output = output;
+static void render_graphical(int draw_all_layers){
 
-    output = stdout;
+    if(output != stdout){
+        request_file_frame(FILE_FRAME_GRAPHICAL, draw_all_layers);
+        return ;
+    }
+    if(require_tileset()) return ;
+
+    FrameView view = get_live_view(draw_all_layers);
+    if(set_view_scale(&view, draw_all_layers)) return ;
+    int drawnw = 0;
+    int drawnh = 0;
+    if(draw_graphical_frame(&view, draw_all_layers, &drawnw, &drawnh)) return ;
+    // one line per pixel row
+    term_scroll_lines = framebuffer_scroll;
+    term_scroll_top = 0;
+    present_term_pixels(drawnw, drawnh);
+}
 
-    print_map(draw_all_layers);
+// like render_graphical but on the terminal each character cell shows two pixels,
+// the top one as the foreground of an upper half block and the bottom one as its background
+static void render_half_block(int draw_all_layers){
 
-    output = saved_output;
+    if(output != stdout){
+        render_graphical(draw_all_layers);
+        return ;
+    }
 
-    if(output == stdout){
+    if(require_tileset()) return ;
+
+    FrameView view = get_live_view(draw_all_layers);
+    if(set_view_scale(&view, draw_all_layers)) return ;
+    int drawnw = 0;
+    int drawnh = 0;
+    if(draw_graphical_frame(&view, draw_all_layers, &drawnw, &drawnh)) return ;
+
+    if(resize_term_cells(drawnw, (drawnh + 1) / 2)){
+        fprintf(stderr, "[ERROR] could not allocate terminal frame\n");
         return ;
     }
-    render_graphical(draw_all_layers);
+    for(int i = 0; i < term_cellsh; i+=1){
+        const uint32_t* const top    = &pixels[(size_t) (2 * i) * pixelsw];
+        const uint32_t* const bottom = (2 * i + 1 < drawnh)? top + pixelsw : NULL;
+        TermCell* const row = &term_cells[(size_t) i * term_cellsw];
+        for(int j = 0; j < drawnw; j+=1){
+            const uint32_t fg = top[j] & 0xFFFFFF;
+            const uint32_t bg = (bottom)? bottom[j] & 0xFFFFFF : TERM_DEFAULT_COLOR;
+            // two equal pixels don't need the glyph, so the foreground can stay as it is
+            row[j].glyph = (fg == bg)? ' ' : UPPER_HALF_BLOCK;
+            row[j].fg    = fg;
+            row[j].bg    = bg;
+        }
+    }
+    // two pixel rows per line
+    term_scroll_lines = (framebuffer_scroll % 2)? 0 : framebuffer_scroll / 2;
+    term_scroll_top = 0;
+    present_term_cells();
 }
 
-static void render_terminal_and_print_map(int draw_all_layers){
+// sixel is an indexed format, the frame keeps its own colors when it has at most SIXEL_MAX_COLORS of them
+// and is quantized to a 6x7x6 color cube otherwise
+#define SIXEL_MAX_COLORS 256
+#define SIXEL_HASH_CAP   1024
+
+static uint8_t* sixel_indices;
+static size_t   sixel_indices_cap;
+static uint8_t* sixel_band;
+static size_t   sixel_band_cap;
+static uint32_t sixel_palette[SIXEL_MAX_COLORS];
+static int      sixel_palette_len;
+
+// fills sixel_indices and sixel_palette from the w * h top left part of the framebuffer
+// \returns 0 on success
+static int quantize_sixel_frame(int w, int h){
+    const size_t size = (size_t) w * h;
+    if(size > sixel_indices_cap){
+        uint8_t* const indices = realloc(sixel_indices, size);
+        if(!indices) return 1;
+        sixel_indices = indices;
+        sixel_indices_cap = size;
+    }
+
+    uint32_t slot_colors[SIXEL_HASH_CAP];
+    int16_t  slot_indices[SIXEL_HASH_CAP];
+    memset(slot_indices, 0xFF, sizeof(slot_indices));
+    sixel_palette_len = 0;
+
+    uint32_t last_color = 0xFFFFFFFF;
+    uint8_t  last_index = 0;
+    for(int i = 0; i < h; i+=1){
+        const uint32_t* const src = &pixels[(size_t) i * pixelsw];
+        uint8_t* const dst = &sixel_indices[(size_t) i * w];
+        for(int j = 0; j < w; j+=1){
+            const uint32_t color = src[j] & 0xFFFFFF;
+            if(color != last_color){
+                uint32_t slot = (color * 2654435761u) >> 22;
+                while(slot_indices[slot] >= 0 && slot_colors[slot] != color) slot = (slot + 1) % SIXEL_HASH_CAP;
+                if(slot_indices[slot] < 0){
+                    if(sixel_palette_len == SIXEL_MAX_COLORS) goto quantize;
+                    slot_colors[slot] = color;
+                    slot_indices[slot] = (int16_t) sixel_palette_len;
+                    sixel_palette[sixel_palette_len++] = color;
+                }
+                last_color = color;
+                last_index = (uint8_t) slot_indices[slot];
+            }
+            dst[j] = last_index;
+        }
+    }
+    return 0;
+
+quantize:
+    sixel_palette_len = 6 * 7 * 6;
+    for(int r = 0; r < 6; r+=1){
+        for(int g = 0; g < 7; g+=1){
+            for(int b = 0; b < 6; b+=1){
+                sixel_palette[(r * 7 + g) * 6 + b] = (uint32_t) (r * 255 / 5) | (uint32_t) (g * 255 / 6) << 8 | (uint32_t) (b * 255 / 5) << 16;
+            }
+        }
+    }
+    for(int i = 0; i < h; i+=1){
+        const uint32_t* const src = &pixels[(size_t) i * pixelsw];
+        uint8_t* const dst = &sixel_indices[(size_t) i * w];
+        for(int j = 0; j < w; j+=1){
+            const uint32_t r = (((src[j] >>  0) & 0xFF) * 5 + 127) / 255;
+            const uint32_t g = (((src[j] >>  8) & 0xFF) * 6 + 127) / 255;
+            const uint32_t b = (((src[j] >> 16) & 0xFF) * 5 + 127) / 255;
+            dst[j] = (uint8_t) ((r * 7 + g) * 6 + b);
+        }
+    }
+    return 0;
+}
+
+// a sixel character repeated count times
+static inline void push_sixel_run(ByteBuffer* buffer, char sixel, int count){
+    if(count > 3){
+        push_byte(buffer, '!');
+        push_uint(buffer, (uint32_t) count);
+        push_byte(buffer, sixel);
+        return ;
+    }
+    while(count--) push_byte(buffer, sixel);
+}
+
+// encodes the w * h top left part of the framebuffer as a sixel image into term_frame
+// \returns 0 on success
+static int push_sixel_image(int w, int h){
+    if(quantize_sixel_frame(w, h)) return 1;
+    // one row of six bit masks per palette color, filled a band at a time
+    const size_t band_size = (size_t) SIXEL_MAX_COLORS * w;
+    if(band_size > sixel_band_cap){
+        uint8_t* const band = realloc(sixel_band, band_size);
+        if(!band) return 1;
+        memset(band, 0, band_size);
+        sixel_band = band;
+        sixel_band_cap = band_size;
+    }
+
+    if(reserve_bytes(&term_frame, 32 + (size_t) sixel_palette_len * 20)) return 1;
+    // 1:1 pixel aspect ratio, the raster attributes give the image size up front
+    push_bytes(&term_frame, "\x1bP0;1q\"1;1;", 11);
+    push_uint(&term_frame, (uint32_t) w);
+    push_byte(&term_frame, ';');
+    push_uint(&term_frame, (uint32_t) h);
+    // the palette is given in percentages
+    for(int i = 0; i < sixel_palette_len; i+=1){
+        push_byte(&term_frame, '#');
+        push_uint8(&term_frame, (uint32_t) i);
+        push_bytes(&term_frame, ";2;", 3);
+        push_uint8(&term_frame, (((sixel_palette[i] >>  0) & 0xFF) * 100 + 127) / 255);
+        push_byte(&term_frame, ';');
+        push_uint8(&term_frame, (((sixel_palette[i] >>  8) & 0xFF) * 100 + 127) / 255);
+        push_byte(&term_frame, ';');
+        push_uint8(&term_frame, (((sixel_palette[i] >> 16) & 0xFF) * 100 + 127) / 255);
+    }
+
+    uint8_t used[SIXEL_MAX_COLORS];
+    uint8_t band_colors[SIXEL_MAX_COLORS];
+    for(int y = 0; y < h; y+=6){
+        const int rows = (h - y < 6)? h - y : 6;
+        int band_color_count = 0;
+        memset(used, 0, sizeof(used));
+        for(int r = 0; r < rows; r+=1){
+            const uint8_t* const src = &sixel_indices[(size_t) (y + r) * w];
+            for(int j = 0; j < w; j+=1){
+                const uint8_t index = src[j];
+                sixel_band[(size_t) index * w + j] |= (uint8_t) (1 << r);
+                if(!used[index]){
+                    used[index] = 1;
+                    band_colors[band_color_count++] = index;
+                }
+            }
+        }
+        for(int c = 0; c < band_color_count; c+=1){
+            uint8_t* const masks = &sixel_band[(size_t) band_colors[c] * w];
+            if(reserve_bytes(&term_frame, 8 + (size_t) w)) return 1;
+            // carriage return to overprint the band with the next color
+            if(c) push_byte(&term_frame, '$');
+            push_byte(&term_frame, '#');
+            push_uint8(&term_frame, band_colors[c]);
+            // the empty columns at the end of a color's row are left out
+            int len = w;
+            for(; len > 0 && !masks[len - 1]; len-=1);
+            char run = 0;
+            int  count = 0;
+            for(int j = 0; j < len; j+=1){
+                const char sixel = (char) ('?' + masks[j]);
+                if(sixel != run){
+                    push_sixel_run(&term_frame, run, count);
+                    run = sixel;
+                    count = 0;
+                }
+                count += 1;
+            }
+            push_sixel_run(&term_frame, run, count);
+            memset(masks, 0, (size_t) w);
+        }
+        if(reserve_bytes(&term_frame, 1)) return 1;
+        push_byte(&term_frame, '-');
+    }
+    if(reserve_bytes(&term_frame, 2)) return 1;
+    push_bytes(&term_frame, "\x1b\\", 2);
+    return 0;
+}
+
+static const char base64_digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// callers reserve 4 * ((size + 2) / 3) bytes
+static void push_base64(ByteBuffer* buffer, const uint8_t* data, size_t size){
+    size_t i = 0;
+    for(; i + 3 <= size; i+=3){
+        const uint32_t x = (uint32_t) data[i] << 16 | (uint32_t) data[i + 1] << 8 | data[i + 2];
+        push_byte(buffer, base64_digits[(x >> 18) & 63]);
+        push_byte(buffer, base64_digits[(x >> 12) & 63]);
+        push_byte(buffer, base64_digits[(x >>  6) & 63]);
+        push_byte(buffer, base64_digits[(x >>  0) & 63]);
+    }
+    if(i < size){
+        const uint32_t x = (uint32_t) data[i] << 16 | ((i + 1 < size)? (uint32_t) data[i + 1] << 8 : 0);
+        push_byte(buffer, base64_digits[(x >> 18) & 63]);
+        push_byte(buffer, base64_digits[(x >> 12) & 63]);
+        push_byte(buffer, (i + 1 < size)? base64_digits[(x >> 6) & 63] : '=');
+        push_byte(buffer, '=');
+    }
+}
+
+// the protocol caps every escape sequence at 4096 bytes of base64, 3072 bytes of data
+#define KITTY_CHUNK_SIZE 3072
+
+static ByteBuffer kitty_rgb;
+
+// encodes the w * h top left part of the framebuffer as a zlib compressed rgb kitty graphics image into term_frame,
+// the image always has the same id so each frame replaces the last one
+// \returns 0 on success
+static int push_kitty_image(int w, int h){
+    kitty_rgb.size = 0;
+    if(reserve_bytes(&kitty_rgb, (size_t) w * h * 3)) return 1;
+    for(int i = 0; i < h; i+=1){
+        const uint32_t* const src = &pixels[(size_t) i * pixelsw];
+        for(int j = 0; j < w; j+=1){
+            push_byte(&kitty_rgb, (char) ((src[j] >>  0) & 0xFF));
+            push_byte(&kitty_rgb, (char) ((src[j] >>  8) & 0xFF));
+            push_byte(&kitty_rgb, (char) ((src[j] >> 16) & 0xFF));
+        }
+    }
+    int compressed_size = 0;
+    unsigned char* const compressed = stbi_zlib_compress((unsigned char*) kitty_rgb.data, (int) kitty_rgb.size, &compressed_size, 8);
+    if(!compressed) return 1;
+
+    const size_t chunks = ((size_t) compressed_size + KITTY_CHUNK_SIZE - 1) / KITTY_CHUNK_SIZE;
+    if(reserve_bytes(&term_frame, 64 + chunks * (16 + KITTY_CHUNK_SIZE / 3 * 4))){
+        free(compressed);
+        return 1;
+    }
+    for(size_t i = 0; i < chunks; i+=1){
+        const size_t offset = i * KITTY_CHUNK_SIZE;
+        const size_t size = ((size_t) compressed_size - offset < KITTY_CHUNK_SIZE)? (size_t) compressed_size - offset : KITTY_CHUNK_SIZE;
+        push_bytes(&term_frame, "\x1b_G", 3);
+        if(i == 0){
+            // q=2 keeps the terminal from answering into stdin
+            push_bytes(&term_frame, "a=T,i=1,q=2,f=24,o=z,s=", 23);
+            push_uint(&term_frame, (uint32_t) w);
+            push_bytes(&term_frame, ",v=", 3);
+            push_uint(&term_frame, (uint32_t) h);
+            push_byte(&term_frame, ',');
+        }
+        push_bytes(&term_frame, (i + 1 < chunks)? "m=1;" : "m=0;", 4);
+        push_base64(&term_frame, &compressed[offset], size);
+        push_bytes(&term_frame, "\x1b\\", 2);
+    }
+    free(compressed);
+    return 0;
+}
 
-    FILE* const saved_output = output;
+// draws the graphical frame as one image on stdout, push_image encodes it into term_frame
+static void present_term_image(int draw_all_layers, int (*push_image)(int, int)){
 
-    output = stdout;
+    if(require_tileset()) return ;
 
-    print_map(draw_all_layers);
+    FrameView view = get_live_view(draw_all_layers);
+    if(set_view_scale(&view, draw_all_layers)) return ;
+    int drawnw = 0;
+    int drawnh = 0;
+    if(draw_graphical_frame(&view, draw_all_layers, &drawnw, &drawnh)) return ;
 
-    output = saved_output;
+    term_frame.size = 0;
+    if(reserve_bytes(&term_frame, 16)){
+        fprintf(stderr, "[ERROR] could not allocate terminal frame\n");
+        return ;
+    }
+    push_bytes(&term_frame, "\x1B[2J\x1B[H\n", 8);
+    if(drawnw > 0 && drawnh > 0 && push_image(drawnw, drawnh)){
+        fprintf(stderr, "[ERROR] could not encode terminal image\n");
+        return ;
+    }
+    if(reserve_bytes(&term_frame, 1)){
+        fprintf(stderr, "[ERROR] could not allocate terminal frame\n");
+        return ;
+    }
+    push_byte(&term_frame, '\n');
+    write_bytes(&term_frame, stdout);
+    // the image isn't made of cells, the next cell frame has to start from scratch
+    invalidate_term_frame();
+}
+
+// like render_graphical but the terminal gets the frame as a sixel image
+static void render_sixel(int draw_all_layers){
+    if(output != stdout){
+        render_graphical(draw_all_layers);
+        return ;
+    }
+    present_term_image(draw_all_layers, push_sixel_image);
+}
+
+// like render_graphical but the terminal gets the frame as a kitty graphics protocol image
+static void render_kitty(int draw_all_layers){
+    if(output != stdout){
+        render_graphical(draw_all_layers);
+        return ;
+    }
+    present_term_image(draw_all_layers, push_kitty_image);
+}
+
+// frames for the output file or image are drawn on their own thread from a snapshot of what the camera sees,
+// so the prompt loop never waits on the output, a frame requested while the last one is still being drawn
+// replaces the one waiting instead of queueing behind it.
+// the terminal is always drawn right away and never coalesced: piped into a file, stdout has to get every frame
+// in order (test.py compares it byte for byte), and on a terminal the frame has to be up before the next prompt,
+// which also keeps the differential frames in step with what the screen shows
+typedef struct FrameSnapshot {
+    FrameView      view;
+    int            kind;
+    int            draw_flag;
+    TILE*          tiles;
+    size_t         tiles_cap;
+    TILE**         layer_tiles;
+    int            layer_tiles_cap;
+    char           symbols[TILE_SYMBOLS_LEN];
+    TILE           mapping[sizeof(tile_mapping) / sizeof(tile_mapping[0])];
+    char*          palette;
+    int            palette_cap;
+    uint32_t*      overview;
+    size_t         overview_cap;
+    CompositeCell* composite;
+    size_t         composite_cap;
+    LayerStyle*    styles;
+    int            styles_cap;
+    // the frame of a FILE_FRAME_TEXT snapshot
+    ByteBuffer     text;
+} FrameSnapshot;
+
+static FrameSnapshot file_frame_snapshots[2];
+static Mailbox       file_frame_mailbox;
+// 1 once the thread runs, -1 if it couldn't be started and the frames are drawn right away
+static int           file_frame_thread = 0;
+
+// copies the part of the map the camera sees, leaves the snapshot as it was on failure
+// \returns 0 on success
+static int take_frame_snapshot(FrameSnapshot* snapshot, int kind, int draw_flag){
+    FrameView live = get_live_view(draw_flag);
+    if(kind == FILE_FRAME_GRAPHICAL && set_view_scale(&live, draw_flag)) return 1;
+    const int x0 = (camerax < 0)? 0 : camerax;
+    const int y0 = (cameray < 0)? 0 : cameray;
+    const int x1 = (camerax + cameraw < mapw)? camerax + cameraw : mapw;
+    const int y1 = (cameray + camerah < maph)? cameray + camerah : maph;
+    // a frame drawn from the overview needs none of the tiles
+    const int w = (x1 > x0 && !live.overview)? x1 - x0 : 0;
+    const int h = (y1 > y0 && !live.overview)? y1 - y0 : 0;
+    const size_t layer_size = (size_t) w * h;
+
+    int overview_columns = 0;
+    int overview_rows = 0;
+    if(live.overview) get_overview_window(&live, &overview_columns, &overview_rows);
+    // never empty, the view tells an overview frame by its pointer
+    const size_t overview_size = (live.overview)? (size_t) overview_columns * overview_rows + 1 : 0;
+    if(overview_size > snapshot->overview_cap){
+        uint32_t* const overview = realloc(snapshot->overview, overview_size * sizeof(overview[0]));
+        if(!overview) return 1;
+        snapshot->overview = overview;
+        snapshot->overview_cap = overview_size;
+    }
+
+    if(live.composite && layer_size > snapshot->composite_cap){
+        CompositeCell* const composite = realloc(snapshot->composite, layer_size * sizeof(composite[0]));
+        if(!composite) return 1;
+        snapshot->composite = composite;
+        snapshot->composite_cap = layer_size;
+    }
+    if(layer_size * layers > snapshot->tiles_cap){
+        TILE* const tiles = realloc(snapshot->tiles, layer_size * layers * sizeof(tiles[0]));
+        if(!tiles) return 1;
+        snapshot->tiles = tiles;
+        snapshot->tiles_cap = layer_size * layers;
+    }
+    if(layers > snapshot->layer_tiles_cap){
+        TILE** const layer_tiles = realloc(snapshot->layer_tiles, layers * sizeof(layer_tiles[0]));
+        if(!layer_tiles) return 1;
+        snapshot->layer_tiles = layer_tiles;
+        snapshot->layer_tiles_cap = layers;
+    }
+    if(live.styles && layers > snapshot->styles_cap){
+        LayerStyle* const styles = realloc(snapshot->styles, layers * sizeof(styles[0]));
+        if(!styles) return 1;
+        snapshot->styles = styles;
+        snapshot->styles_cap = layers;
+    }
+    if(palette_len > snapshot->palette_cap){
+        char* const npalette = realloc(snapshot->palette, palette_len);
+        if(!npalette) return 1;
+        snapshot->palette = npalette;
+        snapshot->palette_cap = palette_len;
+    }
+
+    for(int k = 0; k < layers; k+=1){
+        snapshot->layer_tiles[k] = &snapshot->tiles[k * layer_size];
+        for(int i = 0; i < h; i+=1){
+            memcpy(&snapshot->layer_tiles[k][(size_t) i * w], &map[k][(size_t) (y0 + i) * mapw + x0], w * sizeof(map[0][0]));
+        }
+    }
+    for(int i = 0; live.composite && i < h; i+=1){
+        memcpy(&snapshot->composite[(size_t) i * w], &live.composite[(size_t) (y0 + i) * mapw + x0], w * sizeof(snapshot->composite[0]));
+    }
+    for(int i = 0; i < overview_rows; i+=1){
+        memcpy(
+            &snapshot->overview[(size_t) i * overview_columns],
+            &live.overview[(size_t) (live.overview_y + i) * live.overview_stride + live.overview_x],
+            overview_columns * sizeof(snapshot->overview[0])
+        );
+    }
+    memcpy(snapshot->symbols, tile_symbols, sizeof(snapshot->symbols));
+    memcpy(snapshot->mapping, tile_mapping, sizeof(snapshot->mapping));
+    if(palette_len) memcpy(snapshot->palette, palette, palette_len);
+    if(live.styles) memcpy(snapshot->styles, live.styles, layers * sizeof(snapshot->styles[0]));
+
+    snapshot->view = live;
+    snapshot->view.tiles   = (TILE* const*) snapshot->layer_tiles;
+    snapshot->view.x0      = x0;
+    snapshot->view.y0      = y0;
+    snapshot->view.stride  = w;
+    snapshot->view.symbols = snapshot->symbols;
+    snapshot->view.mapping = snapshot->mapping;
+    snapshot->view.palette = snapshot->palette;
+    if(live.composite) snapshot->view.composite = snapshot->composite;
+    if(live.styles)    snapshot->view.styles    = snapshot->styles;
+    if(live.overview){
+        snapshot->view.overview        = snapshot->overview;
+        snapshot->view.overview_stride = overview_columns;
+        snapshot->view.overview_levelw = overview_columns;
+        snapshot->view.overview_levelh = overview_rows;
+        snapshot->view.overview_x      = 0;
+        snapshot->view.overview_y      = 0;
+    }
+    snapshot->kind = kind;
+    snapshot->draw_flag = draw_flag;
+    return 0;
+}
+
+static void draw_file_frame(const FrameView* view, int kind, int draw_flag){
+    if(kind == FILE_FRAME_MAP) print_map_file(view, draw_flag);
+    else                       draw_graphical_file(view, draw_flag);
+}
+
+static void file_frame_job(void* message){
+    const FrameSnapshot* const snapshot = (const FrameSnapshot*) message;
+    if(snapshot->kind == FILE_FRAME_TEXT) present_file_frame(&snapshot->text, output);
+    else                                  draw_file_frame(&snapshot->view, snapshot->kind, snapshot->draw_flag);
+}
+
+// blocks until the output holds the last requested frame
+static void finish_file_frames(void){
+    if(file_frame_thread > 0) wait_mailbox(&file_frame_mailbox);
+}
+
+// settles everything the drawing thread can't do on its own and starts it the first time
+// \returns 0 if the frame can be drawn, the output might have gone back to stdout otherwise
+static int prepare_file_frame(int kind){
+    if(kind == FILE_FRAME_GRAPHICAL && require_tileset()) return 1;
+    if(kind == FILE_FRAME_GRAPHICAL && get_image_format(output_path) != IMAGE_NONE){
+        if(output){
+            fclose(output);
+            output = NULL;
+        }
+    }
+    else if(open_output_file()){
+        // back on stdout, the thread might still be drawing the last frame for the file
+        finish_file_frames();
+        return 1;
+    }
+
+    if(!file_frame_thread){
+        // the kernels have to be picked before another thread calls them
+        blend_row(NULL, NULL, 0);
+        blend_scaled_row(NULL, NULL, 0, 0);
+        luminance_row(NULL, NULL, 0);
+        file_frame_thread = start_mailbox(&file_frame_mailbox, file_frame_job, &file_frame_snapshots[0], &file_frame_snapshots[1])? -1 : 1;
+    }
+    return 0;
+}
+
+static void request_file_frame(int kind, int draw_flag){
+
+    if(prepare_file_frame(kind)){
+        if(output != stdout)       return ;
+        if(kind == FILE_FRAME_MAP) print_map_terminal(draw_flag);
+        else                       render_graphical(draw_flag);
+        return ;
+    }
+    if(file_frame_thread < 0){
+        FrameView view = get_live_view(draw_flag);
+        if(kind == FILE_FRAME_GRAPHICAL && set_view_scale(&view, draw_flag)) return ;
+        draw_file_frame(&view, kind, draw_flag);
+        return ;
+    }
+
+    FrameSnapshot* const snapshot = (FrameSnapshot*) open_mailbox(&file_frame_mailbox);
+    const int err = take_frame_snapshot(snapshot, kind, draw_flag);
+    post_mailbox(&file_frame_mailbox, !err);
+    if(err) fprintf(stderr, "[ERROR] could not allocate frame snapshot\n");
+}
+
+// \returns the frames that were replaced by a newer one before they were drawn
+static int get_coalesced_frames(void){
+    return (file_frame_thread > 0)? file_frame_mailbox.replaced : 0;
+}
+
+// draws the last requested frame and stops the thread
+static void stop_file_frames(void){
+    if(file_frame_thread > 0) stop_mailbox(&file_frame_mailbox);
+    file_frame_thread = 0;
+    for(int i = 0; i < 2; i+=1){
+        free(file_frame_snapshots[i].tiles);
+        free(file_frame_snapshots[i].layer_tiles);
+        free(file_frame_snapshots[i].palette);
+        free(file_frame_snapshots[i].overview);
+        free(file_frame_snapshots[i].composite);
+        free(file_frame_snapshots[i].styles);
+        free_bytes(&file_frame_snapshots[i].text);
+        memset(&file_frame_snapshots[i], 0, sizeof(file_frame_snapshots[i]));
+    }
+    free_bytes(&file_map_frame);
+}
+
+// the terminal and the output of -O from one walk over the cells the camera sees,
+// a text output gets the very frame the terminal shows and an image output draws from the snapshot the terminal's frame is built from
+static void render_terminal_and_file(int kind, int draw_flag){
 
     if(output == stdout){
+        print_map_terminal(draw_flag);
+        return ;
+    }
+    if(prepare_file_frame(kind)){
+        print_map_terminal(draw_flag);
+        if(output == stdout && kind == FILE_FRAME_GRAPHICAL) render_graphical(draw_flag);
+        return ;
+    }
+
+    const FrameView live = get_live_view(draw_flag);
+    if(file_frame_thread < 0){
+        print_map_terminal(draw_flag);
+        FrameView view = live;
+        if(kind == FILE_FRAME_GRAPHICAL && set_view_scale(&view, draw_flag)) return ;
+        if(kind == FILE_FRAME_MAP) present_file_frame(&map_frame, output);
+        else                       draw_file_frame(&view, kind, draw_flag);
+        return ;
+    }
+
+    if(kind == FILE_FRAME_MAP){
+        if(build_map_text(&live, draw_flag, &map_frame)){
+            fprintf(stderr, "[ERROR] could not allocate map frame\n");
+            return ;
+        }
+        present_map_frame(&live);
+        FrameSnapshot* const snapshot = (FrameSnapshot*) open_mailbox(&file_frame_mailbox);
+        const size_t size = snapshot->text.size;
+        snapshot->text.size = 0;
+        const int err = reserve_bytes(&snapshot->text, map_frame.size);
+        if(err) snapshot->text.size = size;
+        else{
+            push_bytes(&snapshot->text, map_frame.data, map_frame.size);
+            snapshot->kind = FILE_FRAME_TEXT;
+        }
+        post_mailbox(&file_frame_mailbox, !err);
+        if(err) fprintf(stderr, "[ERROR] could not allocate frame snapshot\n");
         return ;
     }
-    print_map(draw_all_layers);
+
+    FrameSnapshot* const snapshot = (FrameSnapshot*) open_mailbox(&file_frame_mailbox);
+    const int err = take_frame_snapshot(snapshot, kind, draw_flag);
+    post_mailbox(&file_frame_mailbox, !err);
+    if(err) fprintf(stderr, "[ERROR] could not allocate frame snapshot\n");
+    // the drawing thread only reads the snapshot and nothing else writes it before the next frame,
+    // an overview snapshot doesn't hold the tiles though
+    const FrameView* const view = (err || snapshot->view.overview)? &live : &snapshot->view;
+    if(build_map_text(view, draw_flag, &map_frame)){
+        fprintf(stderr, "[ERROR] could not allocate map frame\n");
+        return ;
+    }
+    present_map_frame(view);
+}
+
+static void render_terminal_and_graphics(int draw_all_layers){
+    render_terminal_and_file(FILE_FRAME_GRAPHICAL, draw_all_layers);
+}
+
+static void render_terminal_and_print_map(int draw_all_layers){
+    render_terminal_and_file(FILE_FRAME_MAP, draw_all_layers);
+}
+
+static const char* get_display_name(void){
+    if(display == render_graphical)  return "graphics";
+    if(display == render_half_block) return "half block graphics";
+    if(display == render_sixel)      return "sixel graphics";
+    if(display == render_kitty)      return "kitty graphics";
+    return "character";
 }
 
-#endif // =====================  END OF FILE MAP_DESIGNER_H ===========================
\ No newline at end of file
+#endif // =====================  END OF FILE MAP_DESIGNER_H ===========================
@@ -181,6 +181,19 @@ void help(int what){
     case INST_HELP:
         printf("help <optional: what>: displays this help message or, if provided, a help message about <what>\n");
         break;
+    case INST_EXPORT:
+        printf(
+            "export <path> <optional: x> <optional: y> <optional: w> <optional: h>: renders the map with all its layers to a .png, .ppm or .pam image\n"
+            "\tif x, y, w and h are passed only that rect of cells is exported, the image is written a row of cells at a time so maps of any size can be exported\n"
+        );
+        break;
+    case INST_STYLE:
+        printf(
+            "style <layer> <optional: visible> <optional: opacity> <optional: tint>: sets how a layer looks when all layers are shown or exported,\n"
+            "\tvisible is 0 to hide the layer or 1 to show it, opacity goes from 0 to 100 and tint is an RRGGBB hex color the layer's colors are multiplied by,\n"
+            "\twith only the layer its style is printed\n"
+        );
+        break;
     
     default:
         fprintf(stderr, "[ERROR] " __FILE__ ":%i:0: no help for instruction with id %i\n", __LINE__, what);
@@ -212,6 +225,11 @@ int handle_prompt(int argc, const char** argv){
         return 0;
     }
     const int inst = get_instruction(argv[0]);
+
+    // these print their own text over or under the map, possibly scrolling it away
+    if(inst == INST_HELP || inst == INST_SHOW || inst == INST_CHECK || inst == INST_QUERY || inst == INST_EXIT || inst == INST_STYLE)
+        invalidate_term_frame();
+
     switch (inst)
     {
     case INST_EXIT:
@@ -379,6 +397,7 @@ int handle_prompt(int argc, const char** argv){
             }
         }
         palette[tile_number] = nc;
+        tile_symbols_dirty = 1;
         display(0);
     }
         return 0;
@@ -468,6 +487,7 @@ int handle_prompt(int argc, const char** argv){
         map = nmap;
         mapw = w;
         maph = h;
+        mark_map_dirty(0, 0, mapw, maph);
         display(0);
     }
         return 0;
@@ -482,8 +502,10 @@ int handle_prompt(int argc, const char** argv){
         for(int i = 0; i < mapw * maph; i+=1) nmap[current_layer][i] = 0;
         for(int i = current_layer; i < layers; i+=1) nmap[i + 1] = map[i];
         layers += 1;
+        insert_layer_style(current_layer);
         free(map);
         map = nmap;
+        mark_map_dirty(0, 0, mapw, maph);
         display(0);
     }
         return 0;
@@ -498,6 +520,7 @@ int handle_prompt(int argc, const char** argv){
                 map[i] = map[i + 1];
             }
             layers -= 1;
+            remove_layer_style(current_layer);
         }
         else{
             for(int i = 1; i < argc; i+=1){
@@ -521,15 +544,18 @@ int handle_prompt(int argc, const char** argv){
                         map[i] = map[i + 1];
                     }
                     layers -= 1;
+                    remove_layer_style(k);
                 }
             }
         }
         if(layers <= 0){
+            free_layer_styles();
             layers = 1;
             map[0] = malloc(mapw * maph * sizeof(map[0][0]));
             for(int i = 0; i < mapw * maph; i+=1) map[0][i] = 0;
         }
         if(current_layer >= layers) current_layer = layers - 1;
+        mark_map_dirty(0, 0, mapw, maph);
         if(err == 0) display(0);
     }
         return 0;
@@ -544,6 +570,8 @@ int handle_prompt(int argc, const char** argv){
         TILE* const first_placeholder = map[first];
         map[first] = map[second];
         map[second] = first_placeholder;
+        swap_layer_styles(first, second);
+        mark_map_dirty(0, 0, mapw, maph);
         display(0);
     }
         return 0;
@@ -564,6 +592,7 @@ int handle_prompt(int argc, const char** argv){
             }
         }
         current_layer = second;
+        mark_map_dirty(0, 0, mapw, maph);
         display(0);
     }
         return 0;
@@ -698,6 +727,61 @@ int handle_prompt(int argc, const char** argv){
         printf("query hit %i times\n", count);
     }
         return 0;
+    case INST_EXPORT:{
+        if(argc != 2 && argc != 6){
+            fprintf(stderr, "[ERROR] export expects 1 or 5 arguments (output path and optionally x, y, w and h), got %i instead\n", argc - 1);
+            return 1;
+        }
+        if(argc == 2){
+            if(export_map(argv[1], 0, 0, mapw, maph)) return 1;
+            return 0;
+        }
+        GET_UINT(x, argv, 2);
+        GET_UINT(y, argv, 3);
+        GET_UINT(w, argv, 4);
+        GET_UINT(h, argv, 5);
+        if(export_map(argv[1], x, y, w, h)) return 1;
+    }
+        return 0;
+    case INST_STYLE:{
+        if(argc != 2 && argc != 4 && argc != 5){
+            fprintf(stderr, "[ERROR] style expects 1, 3 or 4 arguments (layer and optionally visible, opacity and tint), got %i instead\n", argc - 1);
+            return 1;
+        }
+        GET_UINT(layer, argv, 1);
+        if(layer >= layers){
+            fprintf(stderr, "[ERROR] layers only go up to %i, got %i\n", layers - 1, layer);
+            return 1;
+        }
+        if(argc == 2){
+            const LayerStyle* const styles = get_layer_styles();
+            const int visible = (styles)? styles[layer].visible : 1;
+            const int opacity = (styles)? styles[layer].opacity : 255;
+            const uint32_t tint = (styles)? styles[layer].tint : 0xFFFFFF;
+            printf(
+                "layer %i: %s, %i%% opacity, tint %02X%02X%02X\n", layer, (visible)? "visible" : "hidden", (opacity * 100 + 127) / 255,
+                tint & 0xFF, (tint >> 8) & 0xFF, (tint >> 16) & 0xFF
+            );
+            return 0;
+        }
+        GET_UINT(visible, argv, 2);
+        GET_UINT(opacity, argv, 3);
+        if(opacity > 100){
+            fprintf(stderr, "[ERROR] opacity goes up to 100, got %i\n", opacity);
+            return 1;
+        }
+        const int tint = (argc == 5)? parse_color(argv[4]) : 0xFFFFFF;
+        if(tint < 0){
+            fprintf(stderr, "[ERROR] expected an RRGGBB hex color as the tint, got '%s' instead\n", argv[4]);
+            return 1;
+        }
+        if(set_layer_style(layer, visible != 0, (uint8_t) ((opacity * 255 + 50) / 100), (uint32_t) tint)){
+            fprintf(stderr, "[ERROR] could not allocate the layer styles\n");
+            return 1;
+        }
+        display(0);
+    }
+        return 0;
     case INST_HELP:
         printf("\x1B[2J\x1B[H\n");
         if(argc > 1){
@@ -767,18 +851,28 @@ int main(int argc, char** argv){
                 "a handy console map designer for creating and editing maps in console\n"
                 "usage: %s <optional: map_to_load> -<flags> --<kwargs>\n"
                 "flags are:\n"
-                "\to <output>: displays into output, if output has .png extension a graphical display will be forced and as such a tileset will be required\n"
+                "\to <output>: displays into output, if output has an image extension a graphical display will be forced and as such a tileset will be required,\n"
+                "\t\t.png, .bmp, .tga, .ppm, .pam and .qoi are supported, all but .png are quick to write for live previews,\n"
+                "\t\tan output of shm:/<name> publishes the frames into the posix shared memory object /<name> for a local viewer to map instead\n"
                 "\tO: does the same as -o, but also displays map with tiles represented by single characters to terminal\n"
+                "\t256_colors: limits the terminal to the xterm 256 color palette, for terminals and multiplexers that are slow with 24 bit colors\n"
                 "\tw <map width>: sets the map width\n"
                 "\th <map_height>: sets the map height\n"
                 "\tl <layers>: sets the number of layers\n"
                 "\tsingle_character_graphics: displays map with tiles represented by single characters\n"
                 "\tcommon_graphics: display map with tiles represented by graphical form (tilesheet required)\n"
+                "\thalf_block_graphics: same as common_graphics, but the terminal shows two pixels per character (tilesheet required)\n"
+                "\tsixel_graphics: same as common_graphics, but the terminal gets a full resolution sixel image (tilesheet required)\n"
+                "\tkitty_graphics: same as common_graphics, but the terminal gets a full resolution kitty graphics protocol image (tilesheet required)\n"
+                "\tthreads <count>: sets how many threads draw the graphical displays, 0 uses one per cpu and is the default\n"
+                "\tmax_frame <w> <h>: graphical frames that would be bigger than w by h pixels are drawn with sprites downscaled up to 8 times,\n"
+                "\t\tor from an overview of the map with a pixel for every cell or less, 4096 by 4096 by default\n"
                 "\ttw: sets the tileset's tile width\n"
                 "\tth: sets the tileset's tile height\n"
                 "keyword arguments are:\n"
                 "\tpalette <symbol sequence>: sets the tile's symbol palette for display\n"
-                "\ttilesheet <tilesheet_path>: loads the tilesheet that'll get used to graphically draw the map, provide the tilesheet's tile width and height before using this\n"
+                "\ttilesheet <tilesheet_path>: loads the tilesheet that'll get used to graphically draw the map, provide the tilesheet's tile width and height before using this,\n"
+                "\t\ta decoded copy is cached to <tilesheet_path>.cache to speed up later launches\n"
                 "\tascii <character_sequence>: sets the character sequence to use as ascii colors, form drakest to brightest\n"
                 "\tcamera <x> <y> <w> <h>: positions the camera to (x, y) with with=w and height=h\n"
                 "\thelp: displays this help message\n",
@@ -834,12 +928,11 @@ int main(int argc, char** argv){
                 fprintf(stderr, "[ERROR] provide both the tilesheet's tile width and height before using %s\n", argv[i]);
                 MAIN_RETURN_STATUS(1);
             }
-            tileset = stbi_load(argv[++i], &tilesetx, &tilesety, &tileset_comp, 0);
-            if(!tileset){
+            // decoded in the background, only graphical displays wait for it
+            if(request_tileset(argv[++i])){
                 fprintf(stderr, "[ERROR] could not load tileset '%s'\n", argv[i]);
                 MAIN_RETURN_STATUS(1);
             }
-            tileset_path = argv[i];
         }
         else if(cmp_str(argv[i], "--palette")){
             if(++i >= argc){
@@ -848,6 +941,7 @@ int main(int argc, char** argv){
             }
             for(palette_len = 0; argv[i][palette_len]; palette_len += 1);
             palette = argv[i];
+            tile_symbols_dirty = 1;
         }
         else if(cmp_str(argv[i], "-o")){
             if(i + 1 >= argc){
@@ -855,18 +949,19 @@ int main(int argc, char** argv){
                 MAIN_RETURN_STATUS(1);
             }
             output_path = argv[++i];
-            output = fopen(output_path, "w");
-            if(!output){
+            // a shared framebuffer is no file
+            output = (get_image_format(output_path) == IMAGE_SHM)? NULL : fopen(output_path, "w");
+            if(!output && get_image_format(output_path) != IMAGE_SHM){
                 fprintf(stderr, "[ERROR] could not open output '%s'\n", output_path);
                 MAIN_RETURN_STATUS(1);
             }
-            if(is_png_extension(output_path)){
-                if(!tileset){
-                    fprintf(stderr, "[ERROR] provide a tileset to output to .png file\n");
+            if(get_image_format(output_path) != IMAGE_NONE){
+                if(!tileset_path){
+                    fprintf(stderr, "[ERROR] provide a tileset to output to an image file\n");
                     MAIN_RETURN_STATUS(1);
                 }
                 display = render_graphical;
-                fclose(output);
+                if(output) fclose(output);
                 output = NULL;
             }
         }
@@ -876,24 +971,51 @@ int main(int argc, char** argv){
                 MAIN_RETURN_STATUS(1);
             }
             output_path = argv[++i];
-            output = fopen(output_path, "w");
-            if(!output){
+            // a shared framebuffer is no file
+            output = (get_image_format(output_path) == IMAGE_SHM)? NULL : fopen(output_path, "w");
+            if(!output && get_image_format(output_path) != IMAGE_SHM){
                 fprintf(stderr, "[ERROR] could not open output '%s'\n", output_path);
                 MAIN_RETURN_STATUS(1);
             }
-            if(is_png_extension(output_path)){
-                if(!tileset){
-                    fprintf(stderr, "[ERROR] provide a tileset to output to .png file\n");
+            if(get_image_format(output_path) != IMAGE_NONE){
+                if(!tileset_path){
+                    fprintf(stderr, "[ERROR] provide a tileset to output to an image file\n");
                     MAIN_RETURN_STATUS(1);
                 }
                 display = render_terminal_and_graphics;
-                fclose(output);
+                if(output) fclose(output);
                 output = NULL;
             }
             else{
                 display = render_terminal_and_print_map;
             }
         }
+        else if(cmp_str(argv[i], "-threads")){
+            if(i + 1 >= argc){
+                fprintf(stderr, "[ERROR] expected thread count after '-threads'\n");
+                MAIN_RETURN_STATUS(1);
+            }
+            render_threads = parse_uint(argv[++i]);
+            if(render_threads < 0){
+                fprintf(stderr, "[ERROR] invalid thread count '%s'\n", argv[i]);
+                MAIN_RETURN_STATUS(1);
+            }
+        }
+        else if(cmp_str(argv[i], "-max_frame")){
+            if(i + 2 >= argc){
+                fprintf(stderr, "[ERROR] expected width and height after '-max_frame'\n");
+                MAIN_RETURN_STATUS(1);
+            }
+            max_framew = parse_uint(argv[++i]);
+            max_frameh = parse_uint(argv[++i]);
+            if(max_framew <= 0 || max_frameh <= 0){
+                fprintf(stderr, "[ERROR] invalid max frame size '%s' '%s'\n", argv[i - 1], argv[i]);
+                MAIN_RETURN_STATUS(1);
+            }
+        }
+        else if(cmp_str(argv[i], "-256_colors")){
+            term_256_colors = 1;
+        }
         else if(cmp_str(argv[i], "-w")){
             if(i + 1 >= argc){
                 fprintf(stderr, "[ERROR] expected map width after '-w'\n");
@@ -934,6 +1056,27 @@ int main(int argc, char** argv){
             }
             display = render_graphical;
         }
+        else if(cmp_str(argv[i], "-half_block_graphics")){
+            if(display == render_terminal_and_graphics || display == render_terminal_and_print_map){
+                fprintf(stderr, "[ERROR] cannot use %s after -O flag, possible incompatible draw modes\n", argv[i]);
+                MAIN_RETURN_STATUS(1);
+            }
+            display = render_half_block;
+        }
+        else if(cmp_str(argv[i], "-sixel_graphics")){
+            if(display == render_terminal_and_graphics || display == render_terminal_and_print_map){
+                fprintf(stderr, "[ERROR] cannot use %s after -O flag, possible incompatible draw modes\n", argv[i]);
+                MAIN_RETURN_STATUS(1);
+            }
+            display = render_sixel;
+        }
+        else if(cmp_str(argv[i], "-kitty_graphics")){
+            if(display == render_terminal_and_graphics || display == render_terminal_and_print_map){
+                fprintf(stderr, "[ERROR] cannot use %s after -O flag, possible incompatible draw modes\n", argv[i]);
+                MAIN_RETURN_STATUS(1);
+            }
+            display = render_kitty;
+        }
         else if(cmp_str(argv[i], "-single_character_graphics")){
             if(display == render_terminal_and_graphics || display == render_terminal_and_print_map){
                 fprintf(stderr, "[ERROR] cannot use %s after -O flag, possible incompatible draw modes\n", argv[i]);
@@ -1019,7 +1162,7 @@ int main(int argc, char** argv){
 
     if(output == NULL && output_path == NULL) output = stdout;
     if(display == NULL){
-        if(tileset){
+        if(tileset_path){
             display = render_graphical;
         }
         else{
@@ -1038,9 +1181,13 @@ int main(int argc, char** argv){
         printf(">>> ");
         const int prompt_argc = get_user_prompt(&prompt_argv);
         if(prompt_argc < 0) break;
+        const unsigned int frames = term_frames_presented;
         if(handle_prompt(prompt_argc, prompt_argv)){
+            invalidate_term_frame();
             fprintf(stderr, "for a help message enter help <optional: command_name>\n");
         }
+        // the prompt line and whatever the command printed sit under the last frame and can have scrolled it
+        else if(term_frames_presented == frames) invalidate_term_frame();
         buffsize = buff_scope;
     }
     
@@ -1048,6 +1195,8 @@ int main(int argc, char** argv){
     putchar('\n');
 
     defer:
+    stop_file_frames();
+    close_shared_frame();
     if(map){
         for(int k = 0; k < layers; k+=1) free(map[k]);
         free(map);
@@ -1055,9 +1204,19 @@ int main(int argc, char** argv){
     if(map_path){
         free(map_path);
     }
-    if(tileset){
-        free(tileset);
-    }
+    free_tileset();
+    free_framebuffer();
+    free_overview();
+    free_composite();
+    free_layer_styles();
+    free(term_cells);
+    free(term_prev_cells);
+    free_bytes(&term_frame);
+    free_bytes(&map_frame);
+    free_bytes(&ascii_frame);
+    free_bytes(&file_frame);
+    free_bytes(&image_frame);
+    free_render_pool();
     if(output && output != stdout) fclose(output);
 
     return err;
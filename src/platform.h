@@ -0,0 +1,504 @@
+/*
+MIT License
+
+Copyright (c) 2025 oOluki
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// small wrappers around the few os facilities the designer needs (threads, mailboxes, file mappings, shared memory, in place file writes and the terminal),
+// on platforms without posix threads a "thread" simply runs to completion when it is started and a worker pool runs its jobs in order
+
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+    #define MD_NO_THREADS
+    #include <io.h>
+#else
+    #include <pthread.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/ioctl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
+
+typedef struct Thread {
+#ifndef MD_NO_THREADS
+    pthread_t handle;
+#endif
+    int       running;
+} Thread;
+
+// \returns 0 on success, on platforms without threads fn is called right away
+static inline int thread_start(Thread* thread, void* (*fn)(void*), void* arg){
+#ifndef MD_NO_THREADS
+    if(pthread_create(&thread->handle, NULL, fn, arg)) return 1;
+    thread->running = 1;
+#else
+    fn(arg);
+    thread->running = 0;
+#endif
+    return 0;
+}
+
+static inline void thread_join(Thread* thread){
+#ifndef MD_NO_THREADS
+    if(thread->running) pthread_join(thread->handle, NULL);
+#endif
+    thread->running = 0;
+}
+
+
+static int get_cpu_count(void){
+#if !defined(MD_NO_THREADS) && defined(_SC_NPROCESSORS_ONLN)
+    const long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return (count > 0)? (int) count : 1;
+#else
+    return 1;
+#endif
+}
+
+// runs count independent jobs on a set of threads that wait between runs, the calling thread takes jobs too,
+// without threads the jobs just run one after the other
+#define MAX_WORKERS 64
+
+typedef void (*WorkerJob)(void* arg, int index, int count);
+
+typedef struct WorkerPool {
+#ifndef MD_NO_THREADS
+    pthread_t       threads[MAX_WORKERS];
+    pthread_mutex_t lock;
+    pthread_cond_t  wake;
+    pthread_cond_t  done;
+#endif
+    int             thread_count;
+    WorkerJob       job;
+    void*           arg;
+    int             count;
+    int             next;
+    int             finished;
+    unsigned int    generation;
+    int             quit;
+} WorkerPool;
+
+#ifndef MD_NO_THREADS
+// takes jobs of the current run until there are none left, called with the lock held
+static void run_worker_jobs(WorkerPool* pool){
+    while(pool->next < pool->count){
+        const int       index = pool->next++;
+        const WorkerJob job   = pool->job;
+        void* const     arg   = pool->arg;
+        const int       count = pool->count;
+        pthread_mutex_unlock(&pool->lock);
+        job(arg, index, count);
+        pthread_mutex_lock(&pool->lock);
+        if(++pool->finished == pool->count) pthread_cond_signal(&pool->done);
+    }
+}
+
+static void* worker_main(void* arg){
+    WorkerPool* const pool = (WorkerPool*) arg;
+    unsigned int generation = 0;
+    pthread_mutex_lock(&pool->lock);
+    for(;;){
+        while(!pool->quit && pool->generation == generation) pthread_cond_wait(&pool->wake, &pool->lock);
+        if(pool->quit) break;
+        generation = pool->generation;
+        run_worker_jobs(pool);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+#endif
+
+// \param threads the extra threads to start, the pool works with fewer if some can't be started
+// \returns 0 on success
+static int start_worker_pool(WorkerPool* pool, int threads){
+    pool->thread_count = 0;
+    pool->count = 0;
+    pool->next = 0;
+    pool->finished = 0;
+    pool->generation = 0;
+    pool->quit = 0;
+#ifndef MD_NO_THREADS
+    if(pthread_mutex_init(&pool->lock, NULL)) return 1;
+    if(pthread_cond_init(&pool->wake, NULL)){
+        pthread_mutex_destroy(&pool->lock);
+        return 1;
+    }
+    if(pthread_cond_init(&pool->done, NULL)){
+        pthread_cond_destroy(&pool->wake);
+        pthread_mutex_destroy(&pool->lock);
+        return 1;
+    }
+    if(threads > MAX_WORKERS) threads = MAX_WORKERS;
+    for(; pool->thread_count < threads; pool->thread_count+=1){
+        if(pthread_create(&pool->threads[pool->thread_count], NULL, worker_main, pool)) break;
+    }
+#else
+    (void) threads;
+#endif
+    return 0;
+}
+
+// runs job(arg, 0, count) ... job(arg, count - 1, count) and returns once all of them are done
+static void run_worker_pool(WorkerPool* pool, WorkerJob job, void* arg, int count){
+#ifndef MD_NO_THREADS
+    if(pool->thread_count){
+        pthread_mutex_lock(&pool->lock);
+        pool->job = job;
+        pool->arg = arg;
+        pool->count = count;
+        pool->next = 0;
+        pool->finished = 0;
+        pool->generation += 1;
+        pthread_cond_broadcast(&pool->wake);
+        run_worker_jobs(pool);
+        while(pool->finished < pool->count) pthread_cond_wait(&pool->done, &pool->lock);
+        pthread_mutex_unlock(&pool->lock);
+        return ;
+    }
+#endif
+    for(int i = 0; i < count; i+=1) job(arg, i, count);
+}
+
+static void stop_worker_pool(WorkerPool* pool){
+#ifndef MD_NO_THREADS
+    pthread_mutex_lock(&pool->lock);
+    pool->quit = 1;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+    for(int i = 0; i < pool->thread_count; i+=1) pthread_join(pool->threads[i], NULL);
+    pthread_cond_destroy(&pool->done);
+    pthread_cond_destroy(&pool->wake);
+    pthread_mutex_destroy(&pool->lock);
+#endif
+    pool->thread_count = 0;
+}
+
+// hands messages to a thread that only cares about the newest one, the caller fills slots[0] between open_mailbox and post_mailbox
+// and the thread runs job on its own copy in slots[1], a message posted before the thread took the last one replaces it,
+// there is no mailbox without threads, start_mailbox fails and the caller does the job itself
+typedef struct Mailbox {
+#ifndef MD_NO_THREADS
+    pthread_t       thread;
+    pthread_mutex_t lock;
+    pthread_cond_t  posted;
+    pthread_cond_t  idle;
+#endif
+    void          (*job)(void* message);
+    void*           slots[2];
+    int             pending;
+    int             busy;
+    int             quit;
+    // messages that were replaced before the thread got to them
+    int             replaced;
+} Mailbox;
+
+#ifndef MD_NO_THREADS
+static void* mailbox_main(void* arg){
+    Mailbox* const box = (Mailbox*) arg;
+    pthread_mutex_lock(&box->lock);
+    for(;;){
+        while(!box->pending && !box->quit) pthread_cond_wait(&box->posted, &box->lock);
+        // the last message is still delivered when quitting
+        if(!box->pending) break;
+        void* const message = box->slots[0];
+        box->slots[0] = box->slots[1];
+        box->slots[1] = message;
+        box->pending = 0;
+        box->busy = 1;
+        pthread_mutex_unlock(&box->lock);
+        box->job(message);
+        pthread_mutex_lock(&box->lock);
+        box->busy = 0;
+        if(!box->pending) pthread_cond_broadcast(&box->idle);
+    }
+    pthread_mutex_unlock(&box->lock);
+    return NULL;
+}
+#endif
+
+// \param slot0 \param slot1 the two messages the caller and the thread swap between them
+// \returns 0 on success
+static int start_mailbox(Mailbox* box, void (*job)(void*), void* slot0, void* slot1){
+    box->job = job;
+    box->slots[0] = slot0;
+    box->slots[1] = slot1;
+    box->pending = 0;
+    box->busy = 0;
+    box->quit = 0;
+    box->replaced = 0;
+#ifndef MD_NO_THREADS
+    if(pthread_mutex_init(&box->lock, NULL)) return 1;
+    if(pthread_cond_init(&box->posted, NULL)){
+        pthread_mutex_destroy(&box->lock);
+        return 1;
+    }
+    if(pthread_cond_init(&box->idle, NULL)){
+        pthread_cond_destroy(&box->posted);
+        pthread_mutex_destroy(&box->lock);
+        return 1;
+    }
+    if(pthread_create(&box->thread, NULL, mailbox_main, box)){
+        pthread_cond_destroy(&box->idle);
+        pthread_cond_destroy(&box->posted);
+        pthread_mutex_destroy(&box->lock);
+        return 1;
+    }
+    return 0;
+#else
+    return 1;
+#endif
+}
+
+// \returns the message to fill, the mailbox stays locked until post_mailbox
+static void* open_mailbox(Mailbox* box){
+#ifndef MD_NO_THREADS
+    pthread_mutex_lock(&box->lock);
+#endif
+    return box->slots[0];
+}
+
+// \param filled 0 if the message couldn't be filled, then the one posted before, if any, still goes through
+static void post_mailbox(Mailbox* box, int filled){
+    if(filled){
+        box->replaced += box->pending;
+        box->pending = 1;
+#ifndef MD_NO_THREADS
+        pthread_cond_signal(&box->posted);
+#endif
+    }
+#ifndef MD_NO_THREADS
+    pthread_mutex_unlock(&box->lock);
+#endif
+}
+
+// blocks until the thread is done with every posted message
+static void wait_mailbox(Mailbox* box){
+#ifndef MD_NO_THREADS
+    pthread_mutex_lock(&box->lock);
+    while(box->pending || box->busy) pthread_cond_wait(&box->idle, &box->lock);
+    pthread_mutex_unlock(&box->lock);
+#else
+    (void) box;
+#endif
+}
+
+// delivers the last message and stops the thread
+static void stop_mailbox(Mailbox* box){
+#ifndef MD_NO_THREADS
+    pthread_mutex_lock(&box->lock);
+    box->quit = 1;
+    pthread_cond_signal(&box->posted);
+    pthread_mutex_unlock(&box->lock);
+    pthread_join(box->thread, NULL);
+    pthread_cond_destroy(&box->idle);
+    pthread_cond_destroy(&box->posted);
+    pthread_mutex_destroy(&box->lock);
+#else
+    (void) box;
+#endif
+}
+
+typedef struct MappedFile {
+    void*  data;
+    size_t size;
+    int    is_mapped;
+} MappedFile;
+
+// maps the whole file read only, falls back to reading it into memory
+// \returns 0 on success
+static int map_file(MappedFile* mapped, const char* path){
+    mapped->data = NULL;
+    mapped->size = 0;
+    mapped->is_mapped = 0;
+#ifndef _WIN32
+    const int fd = open(path, O_RDONLY);
+    if(fd < 0) return 1;
+    struct stat st;
+    if(fstat(fd, &st) || st.st_size <= 0){
+        close(fd);
+        return 1;
+    }
+    void* const data = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED) return 1;
+    mapped->data = data;
+    mapped->size = (size_t) st.st_size;
+    mapped->is_mapped = 1;
+    return 0;
+#else
+    FILE* f = fopen(path, "rb");
+    if(!f) return 1;
+    fseek(f, 0, SEEK_END);
+    const long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if(size <= 0){
+        fclose(f);
+        return 1;
+    }
+    mapped->data = malloc((size_t) size);
+    if(!mapped->data || fread(mapped->data, 1, (size_t) size, f) != (size_t) size){
+        free(mapped->data);
+        mapped->data = NULL;
+        fclose(f);
+        return 1;
+    }
+    fclose(f);
+    mapped->size = (size_t) size;
+    return 0;
+#endif
+}
+
+static void unmap_file(MappedFile* mapped){
+    if(!mapped->data) return;
+#ifndef _WIN32
+    if(mapped->is_mapped) munmap(mapped->data, mapped->size);
+    else free(mapped->data);
+#else
+    free(mapped->data);
+#endif
+    mapped->data = NULL;
+    mapped->size = 0;
+    mapped->is_mapped = 0;
+}
+
+typedef struct SharedMemory {
+    void*  data;
+    size_t size;
+    int    fd;
+} SharedMemory;
+
+// creates the posix shared memory object called name and maps size bytes of it read write, a left over object
+// with that name is replaced, and so is the mapped one when it has to grow, since macos only lets an object be sized once
+// \returns 0 on success, the last mapping stays as it was on failure, always fails on windows
+static int map_shared_memory(SharedMemory* shared, const char* name, size_t size){
+#ifndef _WIN32
+    shm_unlink(name);
+    const int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if(fd < 0) return 1;
+    void* const data = (ftruncate(fd, (off_t) size))? MAP_FAILED : mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(data == MAP_FAILED){
+        close(fd);
+        shm_unlink(name);
+        return 1;
+    }
+    if(shared->data){
+        munmap(shared->data, shared->size);
+        close(shared->fd);
+    }
+    shared->data = data;
+    shared->size = size;
+    shared->fd = fd;
+    return 0;
+#else
+    (void) shared;
+    (void) name;
+    (void) size;
+    return 1;
+#endif
+}
+
+// unmaps the object and removes its name, viewers that still map it keep it until they unmap it too
+static void unmap_shared_memory(SharedMemory* shared, const char* name){
+    if(!shared->data) return ;
+#ifndef _WIN32
+    munmap(shared->data, shared->size);
+    close(shared->fd);
+    shm_unlink(name);
+#else
+    (void) name;
+#endif
+    shared->data = NULL;
+    shared->size = 0;
+}
+
+// keeps the stores before it from being seen after the ones that follow it by other threads or processes
+static inline void memory_barrier(void){
+#if defined(__GNUC__) || defined(__clang__)
+    __sync_synchronize();
+#endif
+}
+
+// writes size bytes at offset without going through f's buffer or moving its position, flush f before mixing the two
+// \returns 0 on success
+static int write_file_at(FILE* f, const void* data, size_t size, long long offset){
+    const char* bytes = (const char*) data;
+#ifndef _WIN32
+    const int fd = fileno(f);
+    while(size){
+        const ssize_t written = pwrite(fd, bytes, size, (off_t) offset);
+        if(written <= 0) return 1;
+        bytes  += written;
+        size   -= (size_t) written;
+        offset += written;
+    }
+#else
+    const int fd = _fileno(f);
+    if(_lseeki64(fd, offset, SEEK_SET) < 0) return 1;
+    while(size){
+        const int written = _write(fd, bytes, (size > 0x40000000)? 0x40000000 : (unsigned int) size);
+        if(written <= 0) return 1;
+        bytes += written;
+        size  -= (size_t) written;
+    }
+#endif
+    return 0;
+}
+
+// \returns 0 on success
+static int truncate_file(FILE* f, long long size){
+#ifndef _WIN32
+    return ftruncate(fileno(f), (off_t) size) != 0;
+#else
+    return _chsize_s(_fileno(f), size) != 0;
+#endif
+}
+
+static inline int is_terminal(FILE* f){
+#ifndef _WIN32
+    return isatty(fileno(f));
+#else
+    return _isatty(_fileno(f));
+#endif
+}
+
+// \returns 0 if the size of the terminal behind f is known
+static int get_terminal_size(FILE* f, int* columns, int* rows){
+#if !defined(_WIN32) && defined(TIOCGWINSZ)
+    struct winsize size;
+    if(ioctl(fileno(f), TIOCGWINSZ, &size) || size.ws_col == 0 || size.ws_row == 0) return 1;
+    *columns = size.ws_col;
+    *rows = size.ws_row;
+    return 0;
+#else
+    (void) f;
+    (void) columns;
+    (void) rows;
+    return 1;
+#endif
+}
+
+#endif // =====================  END OF FILE PLATFORM_H ===========================
@@ -2,6 +2,8 @@ import os
 import platform
 import sys
 import locale
+import struct
+import zlib
 
 ENCODING = locale.getpreferredencoding()
 print(f"Default encoding: {ENCODING}")
@@ -43,4 +45,88 @@ if(not cmpf("dummymap.txt", MAP, "r")):
     print("test does not generate expected map")
     exit(1)
 
+def read_pam(path):
+    file = open(path, "rb")
+    data = file.read()
+    file.close()
+    header, _, pixels = data.partition(b"ENDHDR\n")
+    fields = dict(line.split(b" ", 1) for line in header.split(b"\n")[1:] if b" " in line)
+    return int(fields[b"WIDTH"]), int(fields[b"HEIGHT"]), pixels
+
+# decodes an 8 bit rgba png, checking every chunk's crc and, through zlib, the adler32 of the image data
+def read_png(path):
+    file = open(path, "rb")
+    data = file.read()
+    file.close()
+    if data[:8] != b"\x89PNG\r\n\x1a\n":
+        return None
+    i = 8
+    idat = b""
+    w = h = 0
+    while i < len(data):
+        length, kind = struct.unpack(">I4s", data[i:i + 8])
+        body = data[i + 8:i + 8 + length]
+        if struct.unpack(">I", data[i + 8 + length:i + 12 + length])[0] != zlib.crc32(kind + body):
+            return None
+        if kind == b"IHDR":
+            w, h, depth, color = struct.unpack(">IIBB", body[:10])
+            if depth != 8 or color != 6:
+                return None
+        elif kind == b"IDAT":
+            idat += body
+        i += 12 + length
+    raw = zlib.decompress(idat)
+    stride = w * 4
+    pixels = bytearray()
+    prev = bytearray(stride)
+    for y in range(h):
+        filter = raw[y * (stride + 1)]
+        line = bytearray(raw[y * (stride + 1) + 1:(y + 1) * (stride + 1)])
+        for x in range(stride):
+            a = line[x - 4] if x >= 4 else 0
+            b = prev[x]
+            c = prev[x - 4] if x >= 4 else 0
+            if filter == 1:
+                line[x] = (line[x] + a) & 0xFF
+            elif filter == 2:
+                line[x] = (line[x] + b) & 0xFF
+            elif filter == 3:
+                line[x] = (line[x] + (a + b) // 2) & 0xFF
+            elif filter == 4:
+                p = a + b - c
+                pa, pb, pc = abs(p - a), abs(p - b), abs(p - c)
+                line[x] = (line[x] + (a if pa <= pb and pa <= pc else b if pb <= pc else c)) & 0xFF
+        pixels += line
+        prev = line
+    return w, h, bytes(pixels)
+
+# exports a rect of the expected map, with a few more tiles placed, to .png and .pam and compares both
+# against the graphical -o frame of a camera over the same rect
+EXPORT_FILES = ["test_frame.pam", "test_export.png", "test_export.pam"]
+export_input = open("test_export_input.txt", "w")
+export_input.write("pencil 1 1\n")
+for tile in range(1, 40):
+    export_input.write(f"hold {tile}\nplace {tile % 10} {tile // 10}\n")
+export_input.write("show mapf\nexport test_export.png 1 0 7 5\nexport test_export.pam 1 0 7 5\n")
+export_input.close()
+EXPORT_CMD = f"{EXECUTABLE} -tw 16 -th 16 --tilesheet assets/sprite_sheet.png --camera 1 0 7 5 -o test_frame.pam {MAP} < test_export_input.txt > {os.devnull}"
+print(f"CMD: '{EXPORT_CMD}'")
+if(os.system(EXPORT_CMD)):
+    print("export run failed^^^")
+    exit(1)
+
+frame = read_pam("test_frame.pam")
+if(frame[:2] != (7 * 16, 5 * 16)):
+    print("test does not draw the expected frame")
+    exit(1)
+if(read_pam("test_export.pam") != frame):
+    print("test does not export the expected .pam")
+    exit(1)
+if(read_png("test_export.png") != frame):
+    print("test does not export the expected .png")
+    exit(1)
+os.remove("test_export_input.txt")
+for path in EXPORT_FILES:
+    os.remove(path)
+
 print("test success!")